@@ -0,0 +1,599 @@
+#pragma once
+
+#include "AES.hpp"
+#include "CPUFeatures.hpp"
+#include "CTS.hpp"
+#include "KeySchedule.hpp"
+#include "Sectors.hpp"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+// Bitsliced, constant-time T-AES (no table lookups, no secret-dependent
+// branches or addresses, key expansion included). The layout is the "ct64" one: each 64-bit word
+// holds one bit position of 16 bytes of 4 blocks, so 8 words carry 4 blocks
+// and SubBytes is a 113-gate Boyar-Peralta circuit evaluated on all of them
+// at once. The word type W is uint64_t or a GCC vector of 2 or 4 uint64_t
+// lanes; every operation below is lane-wise, so a 128-bit word runs 8 blocks
+// (SSE2, always available on x86-64) and a 256-bit word 16 blocks (AVX2,
+// selected at runtime like the VAES kernels).
+
+namespace bitslice {
+
+typedef uint64_t u64x2 __attribute__((vector_size(16)));
+typedef uint64_t u64x4 __attribute__((vector_size(32)));
+
+template <typename W> constexpr size_t blocks_per_word = 4 * sizeof(W) / 8;
+
+// Everything is force-inlined into the per-width batch functions at the
+// bottom, so the AVX2 one gets VEX code from the same templates. W is only
+// passed by pointer or reference: a 32-byte vector by value would change
+// the ABI of the non-AVX2 instantiations (-Wpsabi).
+#define BITSLICE_INLINE inline __attribute__((always_inline))
+
+template <typename W> BITSLICE_INLINE void sbox(W *q) {
+  W x0, x1, x2, x3, x4, x5, x6, x7;
+  W y1, y2, y3, y4, y5, y6, y7, y8, y9;
+  W y10, y11, y12, y13, y14, y15, y16, y17, y18, y19;
+  W y20, y21;
+  W z0, z1, z2, z3, z4, z5, z6, z7, z8, z9;
+  W z10, z11, z12, z13, z14, z15, z16, z17;
+  W t0, t1, t2, t3, t4, t5, t6, t7, t8, t9;
+  W t10, t11, t12, t13, t14, t15, t16, t17, t18, t19;
+  W t20, t21, t22, t23, t24, t25, t26, t27, t28, t29;
+  W t30, t31, t32, t33, t34, t35, t36, t37, t38, t39;
+  W t40, t41, t42, t43, t44, t45, t46, t47, t48, t49;
+  W t50, t51, t52, t53, t54, t55, t56, t57, t58, t59;
+  W t60, t61, t62, t63, t64, t65, t66, t67;
+  W s0, s1, s2, s3, s4, s5, s6, s7;
+
+  x0 = q[7];
+  x1 = q[6];
+  x2 = q[5];
+  x3 = q[4];
+  x4 = q[3];
+  x5 = q[2];
+  x6 = q[1];
+  x7 = q[0];
+
+  // Top linear transformation
+  y14 = x3 ^ x5;
+  y13 = x0 ^ x6;
+  y9 = x0 ^ x3;
+  y8 = x0 ^ x5;
+  t0 = x1 ^ x2;
+  y1 = t0 ^ x7;
+  y4 = y1 ^ x3;
+  y12 = y13 ^ y14;
+  y2 = y1 ^ x0;
+  y5 = y1 ^ x6;
+  y3 = y5 ^ y8;
+  t1 = x4 ^ y12;
+  y15 = t1 ^ x5;
+  y20 = t1 ^ x1;
+  y6 = y15 ^ x7;
+  y10 = y15 ^ t0;
+  y11 = y20 ^ y9;
+  y7 = x7 ^ y11;
+  y17 = y10 ^ y11;
+  y19 = y10 ^ y8;
+  y16 = t0 ^ y11;
+  y21 = y13 ^ y16;
+  y18 = x0 ^ y16;
+
+  // Non-linear section (GF(2^8) inversion)
+  t2 = y12 & y15;
+  t3 = y3 & y6;
+  t4 = t3 ^ t2;
+  t5 = y4 & x7;
+  t6 = t5 ^ t2;
+  t7 = y13 & y16;
+  t8 = y5 & y1;
+  t9 = t8 ^ t7;
+  t10 = y2 & y7;
+  t11 = t10 ^ t7;
+  t12 = y9 & y11;
+  t13 = y14 & y17;
+  t14 = t13 ^ t12;
+  t15 = y8 & y10;
+  t16 = t15 ^ t12;
+  t17 = t4 ^ t14;
+  t18 = t6 ^ t16;
+  t19 = t9 ^ t14;
+  t20 = t11 ^ t16;
+  t21 = t17 ^ y20;
+  t22 = t18 ^ y19;
+  t23 = t19 ^ y21;
+  t24 = t20 ^ y18;
+
+  t25 = t21 ^ t22;
+  t26 = t21 & t23;
+  t27 = t24 ^ t26;
+  t28 = t25 & t27;
+  t29 = t28 ^ t22;
+  t30 = t23 ^ t24;
+  t31 = t22 ^ t26;
+  t32 = t31 & t30;
+  t33 = t32 ^ t24;
+  t34 = t23 ^ t33;
+  t35 = t27 ^ t33;
+  t36 = t24 & t35;
+  t37 = t36 ^ t34;
+  t38 = t27 ^ t36;
+  t39 = t29 & t38;
+  t40 = t25 ^ t39;
+
+  t41 = t40 ^ t37;
+  t42 = t29 ^ t33;
+  t43 = t29 ^ t40;
+  t44 = t33 ^ t37;
+  t45 = t42 ^ t41;
+  z0 = t44 & y15;
+  z1 = t37 & y6;
+  z2 = t33 & x7;
+  z3 = t43 & y16;
+  z4 = t40 & y1;
+  z5 = t29 & y7;
+  z6 = t42 & y11;
+  z7 = t45 & y17;
+  z8 = t41 & y10;
+  z9 = t44 & y12;
+  z10 = t37 & y3;
+  z11 = t33 & y4;
+  z12 = t43 & y13;
+  z13 = t40 & y5;
+  z14 = t29 & y2;
+  z15 = t42 & y9;
+  z16 = t45 & y14;
+  z17 = t41 & y8;
+
+  // Bottom linear transformation
+  t46 = z15 ^ z16;
+  t47 = z10 ^ z11;
+  t48 = z5 ^ z13;
+  t49 = z9 ^ z10;
+  t50 = z2 ^ z12;
+  t51 = z2 ^ z5;
+  t52 = z7 ^ z8;
+  t53 = z0 ^ z3;
+  t54 = z6 ^ z7;
+  t55 = z16 ^ z17;
+  t56 = z12 ^ t48;
+  t57 = t50 ^ t53;
+  t58 = z4 ^ t46;
+  t59 = z3 ^ t54;
+  t60 = t46 ^ t57;
+  t61 = z14 ^ t57;
+  t62 = t52 ^ t58;
+  t63 = t49 ^ t58;
+  t64 = z4 ^ t59;
+  t65 = t61 ^ t62;
+  t66 = z1 ^ t63;
+  s0 = t59 ^ t63;
+  s6 = t56 ^ ~t62;
+  s7 = t48 ^ ~t60;
+  t67 = t64 ^ t65;
+  s3 = t53 ^ t66;
+  s4 = t51 ^ t66;
+  s5 = t47 ^ t65;
+  s1 = t64 ^ ~s3;
+  s2 = t55 ^ ~t67;
+
+  q[7] = s0;
+  q[6] = s1;
+  q[5] = s2;
+  q[4] = s3;
+  q[3] = s4;
+  q[2] = s5;
+  q[1] = s6;
+  q[0] = s7;
+}
+
+// Inverse affine map (with the 0x63 constant) shared by inv_sbox
+template <typename W> BITSLICE_INLINE void inv_affine(W *q) {
+  W q0 = ~q[0], q1 = ~q[1], q2 = q[2], q3 = q[3];
+  W q4 = q[4], q5 = ~q[5], q6 = ~q[6], q7 = q[7];
+  q[7] = q1 ^ q4 ^ q6;
+  q[6] = q0 ^ q3 ^ q5;
+  q[5] = q7 ^ q2 ^ q4;
+  q[4] = q6 ^ q1 ^ q3;
+  q[3] = q5 ^ q0 ^ q2;
+  q[2] = q4 ^ q7 ^ q1;
+  q[1] = q3 ^ q6 ^ q0;
+  q[0] = q2 ^ q5 ^ q7;
+}
+
+// S^-1(x) = A^-1(S(A^-1(x))): the forward circuit inverts in GF(2^8) and
+// applies A, so wrapping it in A^-1 on both sides leaves the inversion
+template <typename W> BITSLICE_INLINE void inv_sbox(W *q) {
+  inv_affine(q);
+  sbox(q);
+  inv_affine(q);
+}
+
+template <typename W>
+BITSLICE_INLINE void swap_bits(W &x, W &y, uint64_t cl, uint64_t ch, int s) {
+  W a = x, b = y;
+  x = (a & cl) | ((b & cl) << s);
+  y = ((a & ch) >> s) | (b & ch);
+}
+
+// Transposes the 8 words between "4 blocks interleaved" and bitsliced form
+// (its own inverse)
+template <typename W> BITSLICE_INLINE void ortho(W *q) {
+  constexpr uint64_t C2 = 0x5555555555555555, H2 = 0xAAAAAAAAAAAAAAAA;
+  constexpr uint64_t C4 = 0x3333333333333333, H4 = 0xCCCCCCCCCCCCCCCC;
+  constexpr uint64_t C8 = 0x0F0F0F0F0F0F0F0F, H8 = 0xF0F0F0F0F0F0F0F0;
+  swap_bits(q[0], q[1], C2, H2, 1);
+  swap_bits(q[2], q[3], C2, H2, 1);
+  swap_bits(q[4], q[5], C2, H2, 1);
+  swap_bits(q[6], q[7], C2, H2, 1);
+
+  swap_bits(q[0], q[2], C4, H4, 2);
+  swap_bits(q[1], q[3], C4, H4, 2);
+  swap_bits(q[4], q[6], C4, H4, 2);
+  swap_bits(q[5], q[7], C4, H4, 2);
+
+  swap_bits(q[0], q[4], C8, H8, 4);
+  swap_bits(q[1], q[5], C8, H8, 4);
+  swap_bits(q[2], q[6], C8, H8, 4);
+  swap_bits(q[3], q[7], C8, H8, 4);
+}
+
+// Spreads one block (four little-endian column words) over two words
+inline void interleave_in(uint64_t &q0, uint64_t &q1, const uint8_t *block) {
+  uint32_t w[4];
+  memcpy(w, block, 16);
+  uint64_t x0 = w[0], x1 = w[1], x2 = w[2], x3 = w[3];
+  x0 |= (x0 << 16);
+  x1 |= (x1 << 16);
+  x2 |= (x2 << 16);
+  x3 |= (x3 << 16);
+  x0 &= 0x0000FFFF0000FFFF;
+  x1 &= 0x0000FFFF0000FFFF;
+  x2 &= 0x0000FFFF0000FFFF;
+  x3 &= 0x0000FFFF0000FFFF;
+  x0 |= (x0 << 8);
+  x1 |= (x1 << 8);
+  x2 |= (x2 << 8);
+  x3 |= (x3 << 8);
+  x0 &= 0x00FF00FF00FF00FF;
+  x1 &= 0x00FF00FF00FF00FF;
+  x2 &= 0x00FF00FF00FF00FF;
+  x3 &= 0x00FF00FF00FF00FF;
+  q0 = x0 | (x2 << 8);
+  q1 = x1 | (x3 << 8);
+}
+
+inline void interleave_out(uint8_t *block, uint64_t q0, uint64_t q1) {
+  uint64_t x0 = q0 & 0x00FF00FF00FF00FF;
+  uint64_t x1 = q1 & 0x00FF00FF00FF00FF;
+  uint64_t x2 = (q0 >> 8) & 0x00FF00FF00FF00FF;
+  uint64_t x3 = (q1 >> 8) & 0x00FF00FF00FF00FF;
+  x0 |= (x0 >> 8);
+  x1 |= (x1 >> 8);
+  x2 |= (x2 >> 8);
+  x3 |= (x3 >> 8);
+  x0 &= 0x0000FFFF0000FFFF;
+  x1 &= 0x0000FFFF0000FFFF;
+  x2 &= 0x0000FFFF0000FFFF;
+  x3 &= 0x0000FFFF0000FFFF;
+  uint32_t w[4] = {static_cast<uint32_t>(x0 | (x0 >> 16)),
+                   static_cast<uint32_t>(x1 | (x1 >> 16)),
+                   static_cast<uint32_t>(x2 | (x2 >> 16)),
+                   static_cast<uint32_t>(x3 | (x3 >> 16))};
+  memcpy(block, w, 16);
+}
+
+// Loads up to blocks_per_word<W> blocks (missing ones are zero) into
+// bitsliced form: 64-bit lane l of the words holds blocks 4l .. 4l+3
+template <typename W>
+BITSLICE_INLINE void load(W *q, const uint8_t *in, size_t nblocks) {
+  constexpr size_t LANES = sizeof(W) / 8;
+  alignas(sizeof(W)) uint64_t lanes[8][LANES] = {};
+  for (size_t b = 0; b < nblocks; ++b) {
+    const size_t lane = b / 4, slot = b % 4;
+    interleave_in(lanes[slot][lane], lanes[slot + 4][lane], in + 16 * b);
+  }
+  memcpy(q, lanes, sizeof(lanes));
+  ortho(q);
+}
+
+template <typename W>
+BITSLICE_INLINE void store(W *q, uint8_t *out, size_t nblocks) {
+  constexpr size_t LANES = sizeof(W) / 8;
+  ortho(q);
+  alignas(sizeof(W)) uint64_t lanes[8][LANES];
+  memcpy(lanes, q, sizeof(lanes));
+  for (size_t b = 0; b < nblocks; ++b) {
+    const size_t lane = b / 4, slot = b % 4;
+    interleave_out(out + 16 * b, lanes[slot][lane], lanes[slot + 4][lane]);
+  }
+}
+
+// Round keys are kept in 64-bit bitsliced form (the key in all 4 slots)
+// and broadcast to every lane of W
+template <typename W>
+BITSLICE_INLINE void add_round_key(W *q, const uint64_t *rk) {
+  for (int i = 0; i < 8; ++i)
+    q[i] ^= rk[i];
+}
+
+template <typename W> BITSLICE_INLINE void add_words(W *q, const W *k) {
+  for (int i = 0; i < 8; ++i)
+    q[i] ^= k[i];
+}
+
+template <typename W> BITSLICE_INLINE void shift_rows(W *q) {
+  for (int i = 0; i < 8; ++i) {
+    W x = q[i];
+    q[i] = (x & 0x000000000000FFFF) | ((x & 0x00000000FFF00000) >> 4) |
+           ((x & 0x00000000000F0000) << 12) |
+           ((x & 0x0000FF0000000000) >> 8) | ((x & 0x000000FF00000000) << 8) |
+           ((x & 0xF000000000000000) >> 12) |
+           ((x & 0x0FFF000000000000) << 4);
+  }
+}
+
+template <typename W> BITSLICE_INLINE void inv_shift_rows(W *q) {
+  for (int i = 0; i < 8; ++i) {
+    W x = q[i];
+    q[i] = (x & 0x000000000000FFFF) | ((x & 0x000000000FFF0000) << 4) |
+           ((x & 0x00000000F0000000) >> 12) |
+           ((x & 0x000000FF00000000) << 8) |
+           ((x & 0x0000FF0000000000) >> 8) |
+           ((x & 0x000F000000000000) << 12) |
+           ((x & 0xFFF0000000000000) >> 4);
+  }
+}
+
+// Rotations of a column by one and two rows (rows are 16-bit groups)
+#define rot16(x) (((x) >> 16) | ((x) << 48))
+#define rot32(x) (((x) << 32) | ((x) >> 32))
+
+template <typename W> BITSLICE_INLINE void mix_columns(W *q) {
+  W q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+  W q4 = q[4], q5 = q[5], q6 = q[6], q7 = q[7];
+  W r0 = rot16(q0), r1 = rot16(q1), r2 = rot16(q2), r3 = rot16(q3);
+  W r4 = rot16(q4), r5 = rot16(q5), r6 = rot16(q6), r7 = rot16(q7);
+
+  q[0] = q7 ^ r7 ^ r0 ^ rot32(q0 ^ r0);
+  q[1] = q0 ^ r0 ^ q7 ^ r7 ^ r1 ^ rot32(q1 ^ r1);
+  q[2] = q1 ^ r1 ^ r2 ^ rot32(q2 ^ r2);
+  q[3] = q2 ^ r2 ^ q7 ^ r7 ^ r3 ^ rot32(q3 ^ r3);
+  q[4] = q3 ^ r3 ^ q7 ^ r7 ^ r4 ^ rot32(q4 ^ r4);
+  q[5] = q4 ^ r4 ^ r5 ^ rot32(q5 ^ r5);
+  q[6] = q5 ^ r5 ^ r6 ^ rot32(q6 ^ r6);
+  q[7] = q6 ^ r6 ^ r7 ^ rot32(q7 ^ r7);
+}
+
+template <typename W> BITSLICE_INLINE void inv_mix_columns(W *q) {
+  W q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+  W q4 = q[4], q5 = q[5], q6 = q[6], q7 = q[7];
+  W r0 = rot16(q0), r1 = rot16(q1), r2 = rot16(q2), r3 = rot16(q3);
+  W r4 = rot16(q4), r5 = rot16(q5), r6 = rot16(q6), r7 = rot16(q7);
+
+  q[0] = q5 ^ q6 ^ q7 ^ r0 ^ r5 ^ r7 ^ rot32(q0 ^ q5 ^ q6 ^ r0 ^ r5);
+  q[1] = q0 ^ q5 ^ r0 ^ r1 ^ r5 ^ r6 ^ r7 ^
+         rot32(q1 ^ q5 ^ q7 ^ r1 ^ r5 ^ r6);
+  q[2] = q0 ^ q1 ^ q6 ^ r1 ^ r2 ^ r6 ^ r7 ^
+         rot32(q0 ^ q2 ^ q6 ^ r2 ^ r6 ^ r7);
+  q[3] = q0 ^ q1 ^ q2 ^ q5 ^ q6 ^ r0 ^ r2 ^ r3 ^ r5 ^
+         rot32(q0 ^ q1 ^ q3 ^ q5 ^ q6 ^ q7 ^ r0 ^ r3 ^ r5 ^ r7);
+  q[4] = q1 ^ q2 ^ q3 ^ q5 ^ r1 ^ r3 ^ r4 ^ r5 ^ r6 ^ r7 ^
+         rot32(q1 ^ q2 ^ q4 ^ q5 ^ q7 ^ r1 ^ r4 ^ r5 ^ r6);
+  q[5] = q2 ^ q3 ^ q4 ^ q6 ^ r2 ^ r4 ^ r5 ^ r6 ^ r7 ^
+         rot32(q2 ^ q3 ^ q5 ^ q6 ^ r2 ^ r5 ^ r6 ^ r7);
+  q[6] = q3 ^ q4 ^ q5 ^ q7 ^ r3 ^ r5 ^ r6 ^ r7 ^
+         rot32(q3 ^ q4 ^ q6 ^ q7 ^ r3 ^ r6 ^ r7);
+  q[7] = q4 ^ q5 ^ q6 ^ r4 ^ r6 ^ r7 ^ rot32(q4 ^ q5 ^ q7 ^ r4 ^ r7);
+}
+
+#undef rot16
+#undef rot32
+
+/// @brief Encrypts or decrypts up to blocks_per_word<W> blocks
+/// @param rk Bitsliced round keys, 8 words per round (Rounds + 1 rounds)
+/// @param tweaked Forward tweak-round key of each block (Tweaked only)
+template <typename W, int Rounds, int TweakRound, bool Decrypt, bool Tweaked>
+BITSLICE_INLINE void crypt(const uint64_t (*rk)[8], const uint8_t *in,
+                           uint8_t *out, size_t nblocks,
+                           const uint8_t *tweaked) {
+  W q[8], tk[8];
+  load(q, in, nblocks);
+  if (Tweaked)
+    load(tk, tweaked, nblocks);
+
+  if (!Decrypt) {
+    add_round_key(q, rk[0]);
+    for (int round = 1; round < Rounds; ++round) {
+      sbox(q);
+      shift_rows(q);
+      mix_columns(q);
+      if (Tweaked && round == TweakRound)
+        add_words(q, tk);
+      else
+        add_round_key(q, rk[round]);
+    }
+    sbox(q);
+    shift_rows(q);
+    add_round_key(q, rk[Rounds]);
+  } else {
+    add_round_key(q, rk[Rounds]);
+    for (int round = Rounds - 1; round >= 1; --round) {
+      inv_shift_rows(q);
+      inv_sbox(q);
+      if (Tweaked && round == TweakRound)
+        add_words(q, tk);
+      else
+        add_round_key(q, rk[round]);
+      inv_mix_columns(q);
+    }
+    inv_shift_rows(q);
+    inv_sbox(q);
+    add_round_key(q, rk[0]);
+  }
+  store(q, out, nblocks);
+}
+
+// One entry point per word width; the AVX2 one is compiled for AVX2 with
+// the inlined templates above, the SSE2 one for the x86-64 baseline
+template <int Rounds, int TweakRound, bool Decrypt, bool Tweaked>
+void crypt_sse2(const uint64_t (*rk)[8], const uint8_t *in, uint8_t *out,
+                size_t nblocks, const uint8_t *tweaked) {
+  crypt<u64x2, Rounds, TweakRound, Decrypt, Tweaked>(rk, in, out, nblocks,
+                                                     tweaked);
+}
+
+template <int Rounds, int TweakRound, bool Decrypt, bool Tweaked>
+__attribute__((target("avx2"))) void
+crypt_avx2(const uint64_t (*rk)[8], const uint8_t *in, uint8_t *out,
+           size_t nblocks, const uint8_t *tweaked) {
+  crypt<u64x4, Rounds, TweakRound, Decrypt, Tweaked>(rk, in, out, nblocks,
+                                                     tweaked);
+}
+
+#undef BITSLICE_INLINE
+
+/// @brief S-box on each byte of a 32-bit word through the same circuit as
+/// the rounds (one word in slot 0, the rest of the state is discarded), so
+/// the key expansion makes no key-dependent lookups either
+inline uint32_t sub_word(uint32_t x) {
+  uint64_t q[8] = {x};
+  ortho(q);
+  sbox(q);
+  ortho(q);
+  return static_cast<uint32_t>(q[0]);
+}
+
+/// @brief Whether the 16-block AVX2 path is used (host support, capped by
+/// TAES_BITSLICE=sse2)
+inline bool use_avx2() {
+  static const bool avx2 = [] {
+    const char *forced = getenv("TAES_BITSLICE");
+    return cpu_features().avx2 && !(forced && strcmp(forced, "sse2") == 0);
+  }();
+  return avx2;
+}
+
+} // namespace bitslice
+
+/// @brief Constant-time bitsliced T-AES with the same bulk interface as AES.
+/// Runs 16 blocks per step with AVX2, 8 with SSE2; short tails are padded
+/// into one step. Block i of a call uses tweak_start + i, and the tweak is
+/// added to the middle round key exactly as in AES/AESNI, so all engines
+/// produce identical output.
+class AESBitslice : public BulkCipher<AESBitslice> {
+  friend class BulkCipher<AESBitslice>;
+
+  int key_size;
+  int n_rounds;
+
+  // Expanded keys, shared read-only (same object AES and AESNI use)
+  shared_ptr<const KeySchedule> schedule;
+
+  // Round keys in bitsliced form (key replicated over the 4 block slots)
+  alignas(64) uint64_t sliced[KeySchedule::MAX_ROUNDS + 1][8];
+
+  void slice_round_keys() {
+    for (int r = 0; r <= n_rounds; ++r) {
+      uint64_t q[8];
+      for (int slot = 0; slot < 4; ++slot)
+        bitslice::interleave_in(q[slot], q[slot + 4], schedule->enc[r]);
+      bitslice::ortho(q);
+      memcpy(sliced[r], q, sizeof(q));
+    }
+  }
+
+  // Runs the whole call with the fixed-size kernel for KeyBits and the
+  // widest word type, building the per-block tweaked keys step by step
+  template <int KeyBits, bool Decrypt>
+  void process(const uint8_t *in, uint8_t *out, size_t nblocks,
+               const uint8_t *tweak_start) const {
+    constexpr int R = KeyTraits<KeyBits>::ROUNDS;
+    constexpr int T = KeyTraits<KeyBits>::TWEAK_ROUND;
+    const bool wide = bitslice::use_avx2();
+    const size_t step = wide ? bitslice::blocks_per_word<bitslice::u64x4>
+                             : bitslice::blocks_per_word<bitslice::u64x2>;
+
+    uint64_t hi = 0, lo = 0;
+    if (tweak_start)
+      KeySchedule::load_counter(tweak_start, hi, lo);
+    uint8_t tweaked[bitslice::blocks_per_word<bitslice::u64x4>][16];
+
+    for (size_t i = 0; i < nblocks; i += step) {
+      const size_t n = nblocks - i < step ? nblocks - i : step;
+      if (tweak_start) {
+        for (size_t j = 0; j < n; ++j) {
+          KeySchedule::add_tweak_counter(schedule->enc[T], hi, lo,
+                                         tweaked[j]);
+          hi += (++lo == 0);
+        }
+        if (wide)
+          bitslice::crypt_avx2<R, T, Decrypt, true>(sliced, in + 16 * i,
+                                                    out + 16 * i, n,
+                                                    tweaked[0]);
+        else
+          bitslice::crypt_sse2<R, T, Decrypt, true>(sliced, in + 16 * i,
+                                                    out + 16 * i, n,
+                                                    tweaked[0]);
+      } else {
+        if (wide)
+          bitslice::crypt_avx2<R, T, Decrypt, false>(sliced, in + 16 * i,
+                                                     out + 16 * i, n,
+                                                     nullptr);
+        else
+          bitslice::crypt_sse2<R, T, Decrypt, false>(sliced, in + 16 * i,
+                                                     out + 16 * i, n,
+                                                     nullptr);
+      }
+    }
+  }
+
+  template <bool Decrypt>
+  void process_blocks(const uint8_t *in, uint8_t *out, size_t nblocks,
+                      const uint8_t *tweak) const {
+    dispatch_key_size(key_size, [&](auto bits) {
+      process<decltype(bits)::value, Decrypt>(in, out, nblocks, tweak);
+    });
+  }
+
+public:
+  AESBitslice(int size, int rounds, vector<uint8_t> key,
+              vector<uint8_t> tweak_key)
+      : key_size(size), n_rounds(KeySchedule::checked_rounds(size, rounds)),
+        schedule(make_schedule(size, key, tweak_key)) {
+    slice_round_keys();
+  }
+
+  /// @brief Expands key and tweak with the bitsliced S-box, so key setup is
+  /// constant time too (AES::make_schedule indexes the S-box table)
+  /// @param size Key size in bits (128, 192 or 256)
+  /// @param key Key bytes (size / 8)
+  /// @param tweak_key 16-byte tweak, or empty for plain AES
+  static shared_ptr<const KeySchedule>
+  make_schedule(int size, const vector<uint8_t> &key,
+                const vector<uint8_t> &tweak_key) {
+    return KeySchedule::expand(size, key, tweak_key, bitslice::sub_word);
+  }
+
+  /// @brief Shares an existing schedule (only the bitsliced copy is built);
+  /// key setup is only constant time if it came from make_schedule
+  explicit AESBitslice(shared_ptr<const KeySchedule> ks)
+      : key_size(ks->key_size), n_rounds(ks->n_rounds), schedule(move(ks)) {
+    slice_round_keys();
+  }
+
+  const shared_ptr<const KeySchedule> &key_schedule() const {
+    return schedule;
+  }
+
+  /// @brief Words processed per step: "avx2" (16 blocks) or "sse2" (8)
+  static const char *width_name() {
+    return bitslice::use_avx2() ? "avx2" : "sse2";
+  }
+
+};
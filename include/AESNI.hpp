@@ -1,8 +1,15 @@
 #pragma once
 
+#include "./CPUFeatures.hpp"
+#include "./CTS.hpp"
+#include "./KeySchedule.hpp"
+#include "./Sectors.hpp"
+#include "./VAES.hpp"
 #include "./utils.hpp"
 #include <cassert>
 #include <cstdint>
+#include <cstring>
+#include <memory>
 #include <smmintrin.h> // SSE4.1 intrinsics
 #include <stdexcept>
 #include <vector>
@@ -11,16 +18,12 @@
 using namespace std;
 using namespace utils;
 
-#define cpuid(func, ax, bx, cx, dx)                                            \
-  __asm__ __volatile__("cpuid"                                                 \
-                       : "=a"(ax), "=b"(bx), "=c"(cx), "=d"(dx)                \
-                       : "a"(func));
+int Check_CPU_support_AES() { return cpu_features().aesni; }
 
-int Check_CPU_support_AES() {
-  unsigned int a, b, c, d;
-  cpuid(1, a, b, c, d);
-  return (c & 0x2000000);
-}
+// Functions that issue AES-NI (or SSSE3/SSE4.1) instructions carry this
+// target, so translation units built for the x86-64 baseline can include
+// this header; every entry point checks the CPU before any of them runs.
+#define AESNI_TARGET __attribute__((target("aes,sse4.1")))
 
 // Suppress GCC's ignored-attributes warning for using __m128i as a template
 // argument (it carries vector attributes that std::vector ignores). This is
@@ -34,67 +37,273 @@ using m128i_vec = vector<__m128i>;
 #pragma GCC diagnostic pop
 #endif
 
-class AESNI {
-  int key_size;
-  int n_rounds;
-  vector<uint8_t> key;
-  vector<uint8_t> tweak_key;
+/// @brief AES-NI T-AES for one key size. The round count and tweak round are
+/// template constants (KeyTraits), so every round loop below unrolls fully
+/// and the tweak round needs no per-round compare; untweaked bulk calls are a
+/// separate instantiation with no tweak handling at all.
+/// AESNI dispatches to one of these once per call on its runtime key size;
+/// use the engine directly when the key size is fixed (small-record path).
+template <int KeyBits> class AESNIEngine {
+public:
+  static constexpr int ROUNDS = KeyTraits<KeyBits>::ROUNDS;
+  static constexpr int TWEAK_ROUND = KeyTraits<KeyBits>::TWEAK_ROUND;
+  static constexpr int LANES = 8;
 
-  // Round keys storage using __m128i for hardware acceleration
-  m128i_vec round_keys;
+  static const __m128i *enc_keys(const KeySchedule &ks) {
+    return reinterpret_cast<const __m128i *>(ks.enc);
+  }
 
-private:
-  // Helper function to load 16 bytes into __m128i register
-  __m128i load_block(const vector<uint8_t> &block) {
-    assert(block.size() == 16);
-    return _mm_loadu_si128((__m128i *)block.data());
-  }
-
-  // Helper function to store __m128i register into 16 bytes
-  void store_block(__m128i data, vector<uint8_t> &block) {
-    block.resize(16);
-    _mm_storeu_si128((__m128i *)block.data(), data);
-  }
-
-  // Arithmetic addition (mod 2^128) of tweak to round key
-  __m128i add_tweak(const __m128i &round_key, const __m128i &tweak) {
-    // Extract bytes from both operands
-    alignas(16) uint8_t rk_bytes[16];
-    alignas(16) uint8_t tw_bytes[16];
-    alignas(16) uint8_t result_bytes[16];
-
-    _mm_store_si128((__m128i *)rk_bytes, round_key);
-    _mm_store_si128((__m128i *)tw_bytes, tweak);
-
-    // Perform 128-bit addition with carry (little-endian: byte 0 is LSB)
-    uint16_t carry = 0;
-    for (int i = 0; i < 16; ++i) {
-      uint16_t sum = static_cast<uint16_t>(rk_bytes[i]) +
-                     static_cast<uint16_t>(tw_bytes[i]) + carry;
-      result_bytes[i] = static_cast<uint8_t>(sum & 0xFF);
-      carry = sum >> 8;
+  static const __m128i *dec_keys(const KeySchedule &ks) {
+    return reinterpret_cast<const __m128i *>(ks.dec);
+  }
+
+  // Encrypts N independent blocks in lockstep so that N aesenc instructions
+  // are in flight per round instead of one dependent chain.
+  // tweaked: one tweak-round key per block (read only when Tweaked)
+  template <int N, bool Tweaked>
+  AESNI_TARGET static void encrypt_lanes(const __m128i *keys, const __m128i *tweaked,
+                            const uint8_t *in, uint8_t *out) {
+    __m128i s[N];
+    for (int j = 0; j < N; ++j)
+      s[j] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(in + 16 * j)),
+                           keys[0]);
+
+#pragma GCC unroll 16
+    for (int round = 1; round < ROUNDS; ++round) {
+      if (Tweaked && round == TWEAK_ROUND) {
+        for (int j = 0; j < N; ++j)
+          s[j] = _mm_aesenc_si128(s[j], tweaked[j]);
+      } else {
+        const __m128i rk = keys[round];
+        for (int j = 0; j < N; ++j)
+          s[j] = _mm_aesenc_si128(s[j], rk);
+      }
     }
 
-    return _mm_load_si128((__m128i *)result_bytes);
+    const __m128i last = keys[ROUNDS];
+    for (int j = 0; j < N; ++j)
+      _mm_storeu_si128((__m128i *)(out + 16 * j),
+                       _mm_aesenclast_si128(s[j], last));
   }
 
-  int get_tweak_round() const {
-    // Apply tweak in the middle rounds for better security
-    // AES-128: 10 rounds (0-10), apply tweak at round 5
-    // AES-192: 12 rounds (0-12), apply tweak at round 6
-    // AES-256: 14 rounds (0-14), apply tweak at round 7
-    if (key_size == 128)
-      return 5;
-    else if (key_size == 192)
-      return 6;
-    else if (key_size == 256)
-      return 7;
+  // keys: equivalent-inverse schedule; tweaked: InvMixColumns'd tweak keys
+  template <int N, bool Tweaked>
+  AESNI_TARGET static void decrypt_lanes(const __m128i *keys, const __m128i *tweaked,
+                            const uint8_t *in, uint8_t *out) {
+    __m128i s[N];
+    for (int j = 0; j < N; ++j)
+      s[j] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(in + 16 * j)),
+                           keys[ROUNDS]);
+
+#pragma GCC unroll 16
+    for (int round = ROUNDS - 1; round >= 1; --round) {
+      if (Tweaked && round == TWEAK_ROUND) {
+        for (int j = 0; j < N; ++j)
+          s[j] = _mm_aesdec_si128(s[j], tweaked[j]);
+      } else {
+        const __m128i rk = keys[round];
+        for (int j = 0; j < N; ++j)
+          s[j] = _mm_aesdec_si128(s[j], rk);
+      }
+    }
+
+    const __m128i last = keys[0];
+    for (int j = 0; j < N; ++j)
+      _mm_storeu_si128((__m128i *)(out + 16 * j),
+                       _mm_aesdeclast_si128(s[j], last));
+  }
+
+  // Tweak-round key for an explicit 16-byte tweak, forward or inverse form
+  template <bool Decrypt>
+  AESNI_TARGET static __m128i tweak_key(const KeySchedule &ks, const uint8_t *tweak) {
+    alignas(16) uint8_t tweaked_key[16];
+    KeySchedule::add_tweak(ks.enc[TWEAK_ROUND], tweak, tweaked_key);
+    const __m128i tk = _mm_load_si128((const __m128i *)tweaked_key);
+    return Decrypt ? _mm_aesimc_si128(tk) : tk;
+  }
+
+  // Tweaked round key for a counter-mode tweak held as a 128-bit big-endian
+  // integer (hi:lo), the same numbering utils::increment_tweak uses. The
+  // counter bytes are then added to the round key as a little-endian value,
+  // exactly like add_tweak, but with two 64-bit adds instead of a byte loop.
+  AESNI_TARGET static __m128i add_tweak_counter(__m128i round_key, uint64_t hi,
+                                   uint64_t lo) {
+    uint64_t rk_lo = static_cast<uint64_t>(_mm_cvtsi128_si64(round_key));
+    uint64_t rk_hi = static_cast<uint64_t>(_mm_extract_epi64(round_key, 1));
+    uint64_t tw_lo = __builtin_bswap64(hi);
+    uint64_t tw_hi = __builtin_bswap64(lo);
+    uint64_t sum_lo = rk_lo + tw_lo;
+    uint64_t sum_hi = rk_hi + tw_hi + (sum_lo < rk_lo);
+    return _mm_set_epi64x(static_cast<long long>(sum_hi),
+                          static_cast<long long>(sum_lo));
+  }
+
+  /// @brief Bulk path: nblocks contiguous blocks, block i under
+  /// tweak_start + i (big-endian counter), or untweaked when tweak_start is
+  /// nullptr. kernel selects the widest loop (see best_aes_kernel).
+  template <bool Decrypt>
+  AESNI_TARGET static void process_blocks(const KeySchedule &ks, AESKernel kernel,
+                             const uint8_t *in, uint8_t *out, size_t nblocks,
+                             const uint8_t *tweak_start) {
+    if (tweak_start)
+      run<Decrypt, true>(ks, kernel, in, out, nblocks, tweak_start);
     else
-      throw invalid_argument("Invalid key size for tweak rounds");
+      run<Decrypt, false>(ks, kernel, in, out, nblocks, nullptr);
+  }
+
+  /// @brief Shares an existing schedule, which must be for KeyBits
+  explicit AESNIEngine(shared_ptr<const KeySchedule> ks)
+      : schedule(move(ks)), kernel(best_aes_kernel()) {
+    if (!cpu_features().aesni) {
+      throw runtime_error("CPU does not support AES-NI instructions");
+    }
+    if (schedule->key_size != KeyBits) {
+      throw invalid_argument("Key schedule does not match engine key size");
+    }
+  }
+
+  /// @brief Expands key (KeyBits / 8 bytes) and tweak (16 bytes or empty)
+  AESNIEngine(const vector<uint8_t> &key, const vector<uint8_t> &tweak);
+
+  const shared_ptr<const KeySchedule> &key_schedule() const {
+    return schedule;
+  }
+
+  /// @brief Encrypts one 16-byte block under the schedule's tweak
+  void encrypt_block(const uint8_t *in, uint8_t *out) const {
+    encrypt_lanes<1, true>(enc_keys(*schedule),
+                           (const __m128i *)schedule->tweaked_enc, in, out);
+  }
+
+  /// @brief Decrypts one 16-byte block under the schedule's tweak
+  void decrypt_block(const uint8_t *in, uint8_t *out) const {
+    decrypt_lanes<1, true>(dec_keys(*schedule),
+                           (const __m128i *)schedule->tweaked_dec, in, out);
+  }
+
+  /// @brief Encrypts one block under an explicit 16-byte tweak
+  void encrypt_block(const uint8_t *in, uint8_t *out,
+                     const uint8_t *tweak) const {
+    const __m128i tk = tweak_key<false>(*schedule, tweak);
+    encrypt_lanes<1, true>(enc_keys(*schedule), &tk, in, out);
+  }
+
+  /// @brief Decrypts one block under an explicit 16-byte tweak
+  void decrypt_block(const uint8_t *in, uint8_t *out,
+                     const uint8_t *tweak) const {
+    const __m128i tk = tweak_key<true>(*schedule, tweak);
+    decrypt_lanes<1, true>(dec_keys(*schedule), &tk, in, out);
+  }
+
+  /// @brief Encrypts nblocks; tweak_start is 16 bytes or nullptr (untweaked)
+  void encrypt_blocks(const uint8_t *in, uint8_t *out, size_t nblocks,
+                      const uint8_t *tweak_start) const {
+    process_blocks<false>(*schedule, kernel, in, out, nblocks, tweak_start);
+  }
+
+  /// @brief Decrypts nblocks; tweak_start is 16 bytes or nullptr (untweaked)
+  void decrypt_blocks(const uint8_t *in, uint8_t *out, size_t nblocks,
+                      const uint8_t *tweak_start) const {
+    process_blocks<true>(*schedule, kernel, in, out, nblocks, tweak_start);
+  }
+
+private:
+  shared_ptr<const KeySchedule> schedule;
+  AESKernel kernel;
+
+  // Walks nblocks in groups of the selected kernel's width, then groups of
+  // LANES and single blocks for the remainder, preparing one tweaked round
+  // key per block from the running counter.
+  template <bool Decrypt, bool Tweaked>
+  AESNI_TARGET static void run(const KeySchedule &ks, AESKernel kernel, const uint8_t *in,
+                  uint8_t *out, size_t nblocks, const uint8_t *tweak_start) {
+    uint64_t hi = 0, lo = 0;
+    if (Tweaked)
+      KeySchedule::load_counter(tweak_start, hi, lo);
+
+    // While the low counter word does not wrap, only the high qword of the
+    // tweaked key changes from block to block: it is rk_hi + carry +
+    // bswap64(lo + j), so a group is built with one add and one byte shuffle
+    // per block. Groups that wrap take the scalar path.
+    const __m128i bswap_hi = _mm_set_epi8(8, 9, 10, 11, 12, 13, 14, 15,
+                                          -1, -1, -1, -1, -1, -1, -1, -1);
+    alignas(64) __m128i tweaked[vaes::BLOCKS_512];
+    auto next_tweaked_keys = [&](size_t count) AESNI_TARGET {
+      if (!Tweaked)
+        return;
+      const __m128i rk = enc_keys(ks)[TWEAK_ROUND];
+      if (lo <= UINT64_MAX - count) {
+        __m128i base = add_tweak_counter(rk, hi, 0);
+        __m128i ctr = _mm_set_epi64x(static_cast<long long>(lo), 0);
+        const __m128i one = _mm_set_epi64x(1, 0);
+        for (size_t j = 0; j < count; ++j) {
+          __m128i tk = _mm_add_epi64(base, _mm_shuffle_epi8(ctr, bswap_hi));
+          tweaked[j] = Decrypt ? _mm_aesimc_si128(tk) : tk;
+          ctr = _mm_add_epi64(ctr, one);
+        }
+        lo += count;
+        return;
+      }
+      for (size_t j = 0; j < count; ++j) {
+        __m128i tk = add_tweak_counter(rk, hi, lo);
+        tweaked[j] = Decrypt ? _mm_aesimc_si128(tk) : tk;
+        hi += (++lo == 0);
+      }
+    };
+    const __m128i *keys = Decrypt ? dec_keys(ks) : enc_keys(ks);
+
+    size_t i = 0;
+    if (kernel == AESKernel::VAES512) {
+      for (; i + vaes::BLOCKS_512 <= nblocks; i += vaes::BLOCKS_512) {
+        next_tweaked_keys(vaes::BLOCKS_512);
+        vaes::blocks_512<Decrypt, ROUNDS, TWEAK_ROUND, Tweaked>(
+            in + 16 * i, out + 16 * i, keys, tweaked);
+      }
+    }
+    if (kernel != AESKernel::AESNI) {
+      for (; i + vaes::BLOCKS_256 <= nblocks; i += vaes::BLOCKS_256) {
+        next_tweaked_keys(vaes::BLOCKS_256);
+        vaes::blocks_256<Decrypt, ROUNDS, TWEAK_ROUND, Tweaked>(
+            in + 16 * i, out + 16 * i, keys, tweaked);
+      }
+    }
+    for (; i + LANES <= nblocks; i += LANES) {
+      next_tweaked_keys(LANES);
+      if (Decrypt)
+        decrypt_lanes<LANES, Tweaked>(keys, tweaked, in + 16 * i,
+                                      out + 16 * i);
+      else
+        encrypt_lanes<LANES, Tweaked>(keys, tweaked, in + 16 * i,
+                                      out + 16 * i);
+    }
+    for (; i < nblocks; ++i) {
+      next_tweaked_keys(1);
+      if (Decrypt)
+        decrypt_lanes<1, Tweaked>(keys, tweaked, in + 16 * i, out + 16 * i);
+      else
+        encrypt_lanes<1, Tweaked>(keys, tweaked, in + 16 * i, out + 16 * i);
+    }
   }
+};
+
+// Runtime-sized front end: owns key setup and forwards every block operation
+// to AESNIEngine<key_size>, choosing the engine once per call.
+class AESNI : public BulkCipher<AESNI> {
+  friend class BulkCipher<AESNI>;
+
+  int key_size;
+  int n_rounds;
+
+  // Expanded keys (forward, equivalent-inverse, tweaked), shared read-only.
+  // Rows are 16-byte aligned and loaded straight into __m128i registers.
+  shared_ptr<const KeySchedule> schedule;
 
+  // Widest bulk kernel supported by this host (see best_aes_kernel)
+  AESKernel kernel;
+
+private:
   // AES-128 key expansion helper
-  __m128i aes_128_key_expansion(__m128i key, __m128i keygenlast) {
+  AESNI_TARGET static __m128i aes_128_key_expansion(__m128i key, __m128i keygenlast) {
     keygenlast = _mm_shuffle_epi32(keygenlast, 0xFF);
     // xor with the previous 4 bytes 4 times and the keygenlast once
     // keygenlast contains the last 4 words generated in the previous round
@@ -125,7 +334,7 @@ private:
     0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
   };
 
-  uint32_t SubWord_HW(uint32_t word) {
+  static uint32_t SubWord_HW(uint32_t word) {
     uint8_t b0 = sbox[(word >> 24) & 0xFF];
     uint8_t b1 = sbox[(word >> 16) & 0xFF];
     uint8_t b2 = sbox[(word >> 8) & 0xFF];
@@ -133,10 +342,11 @@ private:
     return (b0 << 24) | (b1 << 16) | (b2 << 8) | b3;
   }
 
-  uint32_t RotWord_HW(uint32_t word) {
+  static uint32_t RotWord_HW(uint32_t word) {
     return (word << 8) | (word >> 24);
   }
-  void aes_128_key_expansion_schedule(const vector<uint8_t> &key_bytes) {
+  AESNI_TARGET static void aes_128_key_expansion_schedule(const vector<uint8_t> &key_bytes,
+                                             m128i_vec &round_keys) {
     assert(key_bytes.size() == 16);
     round_keys.clear();
     round_keys.reserve(11);
@@ -167,7 +377,8 @@ private:
   }
 
   // AES-192 key expansion schedule - word-based approach (mirrors software implementation)
-  void aes_192_key_expansion_schedule(const vector<uint8_t> &key_bytes) {
+  AESNI_TARGET static void aes_192_key_expansion_schedule(const vector<uint8_t> &key_bytes,
+                                             m128i_vec &round_keys) {
     assert(key_bytes.size() == 24);
     round_keys.clear();
     round_keys.reserve(13);
@@ -217,7 +428,7 @@ private:
   }
 
   // AES-256 key expansion helpers
-  void aes_256_assist_1(__m128i *temp1, __m128i *temp2) {
+  AESNI_TARGET static void aes_256_assist_1(__m128i *temp1, __m128i *temp2) {
     __m128i temp4;
     *temp2 = _mm_shuffle_epi32(*temp2, 0xff);
     temp4 = _mm_slli_si128(*temp1, 0x4);
@@ -229,7 +440,7 @@ private:
     *temp1 = _mm_xor_si128(*temp1, *temp2);
   }
 
-  void aes_256_assist_2(__m128i *temp1, __m128i *temp3) {
+  AESNI_TARGET static void aes_256_assist_2(__m128i *temp1, __m128i *temp3) {
     __m128i temp2, temp4;
     temp4 = _mm_aeskeygenassist_si128(*temp1, 0x0);
     temp2 = _mm_shuffle_epi32(temp4, 0xaa);
@@ -242,7 +453,8 @@ private:
     *temp3 = _mm_xor_si128(*temp3, temp2);
   }
 
-  void aes_256_key_expansion_schedule(const vector<uint8_t> &key_bytes) {
+  AESNI_TARGET static void aes_256_key_expansion_schedule(const vector<uint8_t> &key_bytes,
+                                             m128i_vec &round_keys) {
     assert(key_bytes.size() == 32);
     round_keys.clear();
     round_keys.reserve(15);
@@ -295,126 +507,163 @@ private:
     round_keys.push_back(temp1);
   }
 
-  void KeyExpansion(const vector<uint8_t> &key_bytes) {
+  AESNI_TARGET static void KeyExpansion(int key_size, const vector<uint8_t> &key_bytes,
+                           m128i_vec &round_keys) {
     if (key_size == 128) {
-      aes_128_key_expansion_schedule(key_bytes);
+      aes_128_key_expansion_schedule(key_bytes, round_keys);
     } else if (key_size == 192) {
-      aes_192_key_expansion_schedule(key_bytes);
+      aes_192_key_expansion_schedule(key_bytes, round_keys);
     } else if (key_size == 256) {
-      aes_256_key_expansion_schedule(key_bytes);
+      aes_256_key_expansion_schedule(key_bytes, round_keys);
     } else {
       throw invalid_argument("Invalid key size. Must be 128, 192, or 256 bits");
     }
   }
 
 public:
+  /// @brief Expands key and tweak once (aeskeygenassist) into an immutable
+  /// schedule that any number of AESNI (or AES) objects and threads can share
+  /// @param size Key size in bits (128, 192 or 256)
+  /// @param key_vec Key bytes (size / 8)
+  /// @param tweak_key_vec 16-byte tweak, or empty for plain AES
+  static shared_ptr<const KeySchedule>
+  make_schedule(int size, const vector<uint8_t> &key_vec,
+                const vector<uint8_t> &tweak_key_vec) {
+    // Verify CPU support for AES-NI
+    if (!Check_CPU_support_AES()) {
+      throw runtime_error("CPU does not support AES-NI instructions");
+    }
+
+    m128i_vec round_keys;
+    KeyExpansion(size, key_vec, round_keys);
+
+    alignas(16) uint8_t forward[KeySchedule::MAX_ROUNDS + 1][16];
+    for (size_t r = 0; r < round_keys.size(); ++r) {
+      _mm_store_si128((__m128i *)forward[r], round_keys[r]);
+    }
+    return KeySchedule::from_round_keys(size, forward, tweak_key_vec);
+  }
+
   AESNI(int size, int rounds, vector<uint8_t> key_vec,
         vector<uint8_t> tweak_key_vec)
-      : key_size(size), n_rounds(rounds), key(key_vec),
-        tweak_key(tweak_key_vec) {
-
-    // Verify CPU support for AES-NI
+      : key_size(size), n_rounds(KeySchedule::checked_rounds(size, rounds)),
+        schedule(make_schedule(size, key_vec, tweak_key_vec)),
+        kernel(best_aes_kernel()) {}
+
+  /// @brief Shares an existing schedule (no key setup work)
+  explicit AESNI(shared_ptr<const KeySchedule> ks)
+      : key_size(ks->key_size), n_rounds(ks->n_rounds), schedule(move(ks)),
+        kernel(best_aes_kernel()) {
     if (!Check_CPU_support_AES()) {
       throw runtime_error("CPU does not support AES-NI instructions");
     }
+  }
 
-    // Perform key expansion
-    KeyExpansion(key);
+  const shared_ptr<const KeySchedule> &key_schedule() const {
+    return schedule;
   }
 
   /// @brief Encrypts a single 16-byte block using AES-NI hardware acceleration
   /// @param block vector<uint8_t> of exactly 16 bytes
   /// @return Returns the encrypted block
-  vector<uint8_t> encrypt_block(vector<uint8_t> block) {
+  vector<uint8_t> encrypt_block(vector<uint8_t> block) const {
     if (block.size() != 16) {
       throw invalid_argument("Block must be exactly 16 bytes");
     }
-
-    // Load block into __m128i register
-    __m128i state = load_block(block);
-
-    // Load tweak if present (initialize to zero to avoid uninitialized warnings)
-    __m128i tweak = _mm_setzero_si128();
-    bool has_tweak = !tweak_key.empty();
-    int tweak_round = 0;
-    if (has_tweak) {
-      tweak = load_block(tweak_key);
-      tweak_round = get_tweak_round();
-    }
-
-    // Initial round - add round key
-    state = _mm_xor_si128(state, round_keys[0]);
-
-    // Main rounds (n_rounds - 1 rounds with full transformations)
-    for (int round = 1; round < n_rounds; ++round) {
-      // Check if we need to apply tweak at this round
-      if (has_tweak && round == tweak_round) {
-        __m128i tweaked_key = add_tweak(round_keys[round], tweak);
-        state = _mm_aesenc_si128(state, tweaked_key);
-      } else {
-        state = _mm_aesenc_si128(state, round_keys[round]);
-      }
-    }
-
-    // Final round (no MixColumns)
-    state = _mm_aesenclast_si128(state, round_keys[n_rounds]);
-
-    // Store result back to vector
-    vector<uint8_t> result;
-    store_block(state, result);
+    // Round key + tweak is precomputed in the schedule (equal to the plain
+    // round key when there is no tweak)
+    vector<uint8_t> result(16);
+    dispatch_key_size(key_size, [&](auto bits) {
+      using Engine = AESNIEngine<decltype(bits)::value>;
+      Engine::template encrypt_lanes<1, true>(
+          Engine::enc_keys(*schedule),
+          (const __m128i *)schedule->tweaked_enc, block.data(),
+          result.data());
+    });
     return result;
   }
 
   /// @brief Decrypts a single 16-byte block using AES-NI hardware acceleration
   /// @param block vector<uint8_t> of exactly 16 bytes
   /// @return Returns the decrypted block
-  vector<uint8_t> decrypt_block(vector<uint8_t> block) {
+  vector<uint8_t> decrypt_block(vector<uint8_t> block) const {
     if (block.size() != 16) {
       throw invalid_argument("Block must be exactly 16 bytes");
     }
+    // Equivalent-inverse-cipher keys come precomputed from the schedule,
+    // including InvMixColumns(round_key + tweak) for the tweak round
+    vector<uint8_t> result(16);
+    dispatch_key_size(key_size, [&](auto bits) {
+      using Engine = AESNIEngine<decltype(bits)::value>;
+      Engine::template decrypt_lanes<1, true>(
+          Engine::dec_keys(*schedule),
+          (const __m128i *)schedule->tweaked_dec, block.data(),
+          result.data());
+    });
+    return result;
+  }
 
-    // Load block into __m128i register
-    __m128i state = load_block(block);
-
-    // Load tweak if present (initialize to zero to avoid uninitialized warnings)
-    __m128i tweak = _mm_setzero_si128();
-    bool has_tweak = !tweak_key.empty();
-    int tweak_round = 0;
-    if (has_tweak) {
-      tweak = load_block(tweak_key);
-      tweak_round = get_tweak_round();
-    }
-
-    // For decryption, we need to use the inverse mix columns transformation
-    // on all round keys except the first and last
-  m128i_vec dec_round_keys = round_keys;
-    for (int i = 1; i < n_rounds; ++i) {
-      dec_round_keys[i] = _mm_aesimc_si128(round_keys[i]);
+  /// @brief Encrypts one block under an explicit tweak, reusing the expanded
+  /// key: only the tweak-round key is recomputed (one 128-bit add)
+  /// @param block vector<uint8_t> of exactly 16 bytes
+  /// @param tweak 16-byte tweak used instead of the constructor tweak
+  /// @return Returns the encrypted block
+  vector<uint8_t> encrypt_block(const vector<uint8_t> &block,
+                                const vector<uint8_t> &tweak) const {
+    if (block.size() != 16 || tweak.size() != 16) {
+      throw invalid_argument("Block and tweak must be exactly 16 bytes");
     }
+    vector<uint8_t> result(16);
+    dispatch_key_size(key_size, [&](auto bits) {
+      using Engine = AESNIEngine<decltype(bits)::value>;
+      const __m128i tk = Engine::template tweak_key<false>(*schedule,
+                                                           tweak.data());
+      Engine::template encrypt_lanes<1, true>(Engine::enc_keys(*schedule),
+                                              &tk, block.data(),
+                                              result.data());
+    });
+    return result;
+  }
 
-    // Initial round - add last round key
-    state = _mm_xor_si128(state, round_keys[n_rounds]);
-
-    // Main rounds (n_rounds - 1 rounds with full transformations)
-    for (int round = n_rounds - 1; round >= 1; --round) {
-      // Check if we need to apply tweak at this round
-      if (has_tweak && round == tweak_round) {
-        // Apply InvMixColumns to (round_key + tweak) combination
-        // Not to round_key and tweak separately!
-        __m128i tweaked_key = add_tweak(round_keys[round], tweak);
-        tweaked_key = _mm_aesimc_si128(tweaked_key);
-        state = _mm_aesdec_si128(state, tweaked_key);
-      } else {
-        state = _mm_aesdec_si128(state, dec_round_keys[round]);
-      }
+  /// @brief Decrypts one block under an explicit tweak (one add and one
+  /// aesimc instead of a key schedule)
+  /// @param block vector<uint8_t> of exactly 16 bytes
+  /// @param tweak 16-byte tweak used instead of the constructor tweak
+  /// @return Returns the decrypted block
+  vector<uint8_t> decrypt_block(const vector<uint8_t> &block,
+                                const vector<uint8_t> &tweak) const {
+    if (block.size() != 16 || tweak.size() != 16) {
+      throw invalid_argument("Block and tweak must be exactly 16 bytes");
     }
+    vector<uint8_t> result(16);
+    dispatch_key_size(key_size, [&](auto bits) {
+      using Engine = AESNIEngine<decltype(bits)::value>;
+      const __m128i tk = Engine::template tweak_key<true>(*schedule,
+                                                          tweak.data());
+      Engine::template decrypt_lanes<1, true>(Engine::dec_keys(*schedule),
+                                              &tk, block.data(),
+                                              result.data());
+    });
+    return result;
+  }
 
-    // Final round (no InvMixColumns)
-    state = _mm_aesdeclast_si128(state, round_keys[0]);
+  /// @brief Bulk kernel used by encrypt_blocks/decrypt_blocks on this host:
+  /// 8 blocks (or 8 VAES registers of 2/4 blocks) in flight per round
+  AESKernel bulk_kernel() const { return kernel; }
 
-    // Store result back to vector
-    vector<uint8_t> result;
-    store_block(state, result);
-    return result;
+private:
+  // Hands the whole call to the fixed-size engine for key_size
+  template <bool Decrypt>
+  void process_blocks(const uint8_t *in, uint8_t *out, size_t nblocks,
+                      const uint8_t *tweak) const {
+    dispatch_key_size(key_size, [&](auto bits) {
+      AESNIEngine<decltype(bits)::value>::template process_blocks<Decrypt>(
+          *schedule, kernel, in, out, nblocks, tweak);
+    });
   }
 };
+
+template <int KeyBits>
+AESNIEngine<KeyBits>::AESNIEngine(const vector<uint8_t> &key,
+                                  const vector<uint8_t> &tweak)
+    : AESNIEngine(AESNI::make_schedule(KeyBits, key, tweak)) {}
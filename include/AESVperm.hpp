@@ -0,0 +1,485 @@
+#pragma once
+
+#include "AES.hpp"
+#include "CPUFeatures.hpp"
+#include "CTS.hpp"
+#include "KeySchedule.hpp"
+#include "Sectors.hpp"
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <tmmintrin.h> // SSSE3 (pshufb)
+#include <vector>
+
+// Vector-permute ("vperm") T-AES for hosts without AES-NI, after Hamburg's
+// SSSE3 AES: the whole 16-byte state stays in one register and SubBytes is
+// computed with 16-entry pshufb lookups on nibbles instead of a 256-byte
+// table, so there are no secret-dependent memory accesses.
+//
+// The S-box inversion runs in the tower field GF(16)[t] / (t^2 + t + lambda).
+// With x = i*t + k, u = lambda*i, j = u ^ k and a = 1/lambda:
+//   io = 1 / (1/u ^ a/k) ^ j   is 1 / y_lo
+//   jo = 1 / (1/j ^ a/k) ^ u   is 1 / (a*y_hi ^ (1 ^ a)*y_lo)
+// for y = x^-1 = y_hi*t + y_lo. Only single-nibble lookups and XORs are
+// needed (Hamburg's trick), so the chain is about ten instructions deep.
+// 1/0 is a table entry with the high bit set, which survives XOR with a
+// nibble and makes the next pshufb return 0 (1/inf = 0).
+//
+// The output tables take (io, jo) straight to the S-box output already
+// multiplied by the MixColumns coefficients, so a round ends in a few
+// pshufb row rotations (ShiftRows folded in) and XORs. The 0x63 of the
+// affine map is linear through MixColumns and is added with the round key.
+//
+// Functions that use pshufb carry target("ssse3"): the software binaries are
+// built for the x86-64 baseline and AESVperm checks SSSE3 at construction.
+
+namespace vperm {
+
+struct Tables {
+  alignas(16) uint8_t enc_in[2][2][16];  // [u, k][lo, hi nibble]
+  alignas(16) uint8_t dec_in[2][2][16];  // same with A^-1 folded in
+  alignas(16) uint8_t inv[16];           // 1/x, 1/0 = INF
+  alignas(16) uint8_t inva[16];          // a/x, a/0 = INF
+  alignas(16) uint8_t enc_out[2][2][16]; // [1x, 2x][io, jo] -> A(y)
+  alignas(16) uint8_t dec_out[5][2][16]; // [1x, 14x, 11x, 13x, 9x][io, jo]
+  alignas(16) uint8_t shift[2][4][16];   // [Shift, InvShift] then rows up
+};
+
+constexpr uint8_t INF = 0x80;
+
+// GF(16) = GF(2)[x] / (x^4 + x + 1)
+constexpr uint8_t gf16_mul(uint8_t a, uint8_t b) {
+  uint8_t p = 0;
+  for (int i = 0; i < 4; ++i) {
+    if (b & 1)
+      p ^= a;
+    b >>= 1;
+    a = static_cast<uint8_t>(a << 1);
+    if (a & 0x10)
+      a ^= 0x13;
+  }
+  return p;
+}
+
+constexpr uint8_t gf16_inv(uint8_t a) {
+  uint8_t r = 0;
+  for (uint8_t b = 1; b < 16; ++b)
+    if (gf16_mul(a, b) == 1)
+      r = b;
+  return r;
+}
+
+// Tower element h*t + l is stored as (h << 4) | l
+constexpr uint8_t tower_mul(uint8_t a, uint8_t b, uint8_t lambda) {
+  const uint8_t a1 = a >> 4, a0 = a & 0xF, b1 = b >> 4, b0 = b & 0xF;
+  const uint8_t hh = gf16_mul(a1, b1);
+  const uint8_t hi = hh ^ gf16_mul(a1, b0) ^ gf16_mul(a0, b1);
+  const uint8_t lo = gf16_mul(hh, lambda) ^ gf16_mul(a0, b0);
+  return static_cast<uint8_t>((hi << 4) | lo);
+}
+
+// x^254 in the AES field (0 maps to 0)
+constexpr uint8_t gf256_inv(uint8_t x) {
+  uint8_t result = 1, base = x;
+  for (int e = 254; e; e >>= 1) {
+    if (e & 1)
+      result = aes_tables::gf_mul(result, base);
+    base = aes_tables::gf_mul(base, base);
+  }
+  return result;
+}
+
+constexpr Tables make_tables() {
+  Tables t{};
+
+  // lambda: t^2 + t + lambda irreducible over GF(16)
+  uint8_t lambda = 1;
+  for (;; ++lambda) {
+    bool has_root = false;
+    for (uint8_t r = 0; r < 16; ++r)
+      has_root |= (gf16_mul(r, r) ^ r) == lambda;
+    if (!has_root)
+      break;
+  }
+  const uint8_t a = gf16_inv(lambda), a_inv = lambda;
+
+  // beta: root of the AES polynomial x^8 + x^4 + x^3 + x + 1 in the tower;
+  // phi(x^n) = beta^n is then a field isomorphism GF(2^8) -> tower
+  uint8_t beta = 2;
+  for (;; ++beta) {
+    uint8_t pw[9] = {1};
+    for (int n = 1; n <= 8; ++n)
+      pw[n] = tower_mul(pw[n - 1], beta, lambda);
+    if ((pw[8] ^ pw[4] ^ pw[3] ^ pw[1] ^ pw[0]) == 0)
+      break;
+  }
+  uint8_t basis[8] = {1};
+  for (int n = 1; n < 8; ++n)
+    basis[n] = tower_mul(basis[n - 1], beta, lambda);
+  uint8_t phi[256] = {}, phi_inv[256] = {};
+  for (int v = 0; v < 256; ++v) {
+    uint8_t m = 0;
+    for (int n = 0; n < 8; ++n)
+      if (v & (1 << n))
+        m ^= basis[n];
+    phi[v] = m;
+    phi_inv[m] = static_cast<uint8_t>(v);
+  }
+
+  // Input: x -> (u, k). For InvSubBytes x first goes through the affine
+  // A^-1(x) = inv(S^-1(x)), whose constant sits in the low-nibble table
+  auto a_inv_map = [](int x) { return gf256_inv(aes_tables::inv_sbox[x]); };
+  const uint8_t a_inv_0 = a_inv_map(0);
+  for (int n = 0; n < 16; ++n) {
+    const uint8_t e[2] = {phi[n], phi[n << 4]};
+    const uint8_t d[2] = {phi[a_inv_map(n)], phi[a_inv_map(n << 4) ^ a_inv_0]};
+    for (int h = 0; h < 2; ++h) {
+      t.enc_in[0][h][n] = gf16_mul(lambda, e[h] >> 4);
+      t.enc_in[1][h][n] = e[h] & 0xF;
+      t.dec_in[0][h][n] = gf16_mul(lambda, d[h] >> 4);
+      t.dec_in[1][h][n] = d[h] & 0xF;
+    }
+  }
+
+  for (int n = 0; n < 16; ++n) {
+    t.inv[n] = n ? gf16_inv(static_cast<uint8_t>(n)) : INF;
+    t.inva[n] = n ? gf16_mul(a, gf16_inv(static_cast<uint8_t>(n))) : INF;
+  }
+
+  // Output: io = 1/y_lo, jo = 1/l with l = a*y_hi ^ (1^a)*y_lo, so
+  // y_hi = (l ^ (1^a)*y_lo) / a; each table holds one term of y
+  const uint8_t dec_mul[5] = {1, 14, 11, 13, 9};
+  for (int n = 1; n < 16; ++n) {
+    const uint8_t v = gf16_inv(static_cast<uint8_t>(n));
+    const uint8_t y_io = static_cast<uint8_t>(
+        (gf16_mul(gf16_mul(1 ^ a, v), a_inv) << 4) | v);
+    const uint8_t y_jo = static_cast<uint8_t>(gf16_mul(v, a_inv) << 4);
+    const uint8_t y[2] = {phi_inv[y_io], phi_inv[y_jo]};
+    for (int o = 0; o < 2; ++o) {
+      // Linear part of the affine map: A(y) ^ 0x63
+      const uint8_t s = aes_tables::sbox[gf256_inv(y[o])] ^ 0x63;
+      t.enc_out[0][o][n] = s;
+      t.enc_out[1][o][n] = aes_tables::gf_mul(s, 2);
+      for (int m = 0; m < 5; ++m)
+        t.dec_out[m][o][n] = aes_tables::gf_mul(y[o], dec_mul[m]);
+    }
+  }
+
+  // Byte r + 4c of (ShiftRows, then rows rotated up by rot) comes from
+  // row r' = r + rot of column c + r' (c - r' for InvShiftRows)
+  for (int inverse = 0; inverse < 2; ++inverse)
+    for (int rot = 0; rot < 4; ++rot)
+      for (int c = 0; c < 4; ++c)
+        for (int r = 0; r < 4; ++r) {
+          const int rr = (r + rot) & 3;
+          const int src = inverse ? (c - rr + 4) & 3 : (c + rr) & 3;
+          t.shift[inverse][rot][r + 4 * c] = static_cast<uint8_t>(rr + 4 * src);
+        }
+  return t;
+}
+
+inline constexpr Tables tables = make_tables();
+
+#define VPERM_INLINE inline __attribute__((target("ssse3"), always_inline))
+
+VPERM_INLINE __m128i lut(const uint8_t *table, __m128i idx) {
+  return _mm_shuffle_epi8(_mm_load_si128((const __m128i *)table), idx);
+}
+
+VPERM_INLINE __m128i lut2(const uint8_t (*table)[16], __m128i io, __m128i jo) {
+  return _mm_xor_si128(lut(table[0], io), lut(table[1], jo));
+}
+
+/// @brief Tower-field inversion of every byte of x (after the input map of
+/// SubBytes or InvSubBytes); returns the (io, jo) nibble pair
+template <bool Inverse>
+VPERM_INLINE void invert(__m128i x, __m128i &io, __m128i &jo) {
+  const Tables &t = tables;
+  const uint8_t(*in)[2][16] = Inverse ? t.dec_in : t.enc_in;
+
+  const __m128i nib = _mm_set1_epi8(0x0F);
+  const __m128i lo = _mm_and_si128(x, nib);
+  const __m128i hi = _mm_and_si128(_mm_srli_epi16(x, 4), nib);
+  const __m128i u = lut2(in[0], lo, hi);
+  const __m128i k = lut2(in[1], lo, hi);
+
+  const __m128i j = _mm_xor_si128(u, k);
+  const __m128i ak = lut(t.inva, k);
+  const __m128i iak = _mm_xor_si128(lut(t.inv, u), ak);
+  const __m128i jak = _mm_xor_si128(lut(t.inv, j), ak);
+  io = _mm_xor_si128(lut(t.inv, iak), j);
+  jo = _mm_xor_si128(lut(t.inv, jak), u);
+}
+
+VPERM_INLINE __m128i shuffle(__m128i x, const uint8_t *mask) {
+  return _mm_shuffle_epi8(x, _mm_load_si128((const __m128i *)mask));
+}
+
+// Row rotations of a 32-bit column: byte r takes byte r + n
+VPERM_INLINE __m128i rot_rows(__m128i x, int n) {
+  return _mm_or_si128(_mm_srli_epi32(x, 8 * n), _mm_slli_epi32(x, 32 - 8 * n));
+}
+
+VPERM_INLINE __m128i xtime(__m128i x) {
+  const __m128i carry = _mm_cmpgt_epi8(_mm_setzero_si128(), x);
+  return _mm_xor_si128(_mm_add_epi8(x, x),
+                       _mm_and_si128(carry, _mm_set1_epi8(0x1b)));
+}
+
+#undef VPERM_INLINE
+
+/// @brief InvMixColumns of a round key (for an explicit tweak on the
+/// decryption side), branch-free
+__attribute__((target("ssse3"))) inline void inv_mix_key(const uint8_t *in,
+                                                         uint8_t *out) {
+  const __m128i a = _mm_loadu_si128((const __m128i *)in);
+  // InvMixColumns = MixColumns after a_i ^= 4 * (a_i ^ a_(i+2))
+  const __m128i p =
+      _mm_xor_si128(a, xtime(xtime(_mm_xor_si128(a, rot_rows(a, 2)))));
+  const __m128i p1 = rot_rows(p, 1);
+  const __m128i m = _mm_xor_si128(
+      _mm_xor_si128(xtime(_mm_xor_si128(p, p1)), p1),
+      _mm_xor_si128(rot_rows(p, 2), rot_rows(p, 3)));
+  _mm_storeu_si128((__m128i *)out, m);
+}
+
+/// @brief SubWord for the key expansion: the S-box on each byte of w from
+/// the same nibble lookups as the rounds
+__attribute__((target("ssse3"))) inline uint32_t sub_word(uint32_t w) {
+  __m128i io, jo;
+  invert<false>(_mm_cvtsi32_si128(static_cast<int>(w)), io, jo);
+  const __m128i s =
+      _mm_xor_si128(lut2(tables.enc_out[0], io, jo), _mm_set1_epi8(0x63));
+  return static_cast<uint32_t>(_mm_cvtsi128_si32(s));
+}
+
+/// @brief One block through Rounds rounds; tweak_key replaces the round key
+/// at TweakRound. Encryption uses the forward keys, decryption the
+/// equivalent inverse cipher (KeySchedule::dec, tweak_key in inverse form)
+template <int Rounds, int TweakRound, bool Decrypt>
+__attribute__((target("ssse3"))) void
+crypt_block(const uint8_t (*rk)[16], const uint8_t *tweak_key,
+            const uint8_t *in, uint8_t *out) {
+  const Tables &t = tables;
+  auto key = [&](int round) {
+    return _mm_loadu_si128(
+        (const __m128i *)(round == TweakRound ? tweak_key : rk[round]));
+  };
+  __m128i s = _mm_loadu_si128((const __m128i *)in);
+  __m128i io, jo;
+
+  if (!Decrypt) {
+    const __m128i affine = _mm_set1_epi8(0x63);
+    s = _mm_xor_si128(s, key(0));
+#pragma GCC unroll 16
+    for (int round = 1; round < Rounds; ++round) {
+      invert<false>(s, io, jo);
+      const __m128i s1 = lut2(t.enc_out[0], io, jo);
+      const __m128i s2 = lut2(t.enc_out[1], io, jo);
+      // 2*a_i ^ 3*a_(i+1) ^ a_(i+2) ^ a_(i+3) of the shifted rows
+      const __m128i m0 = _mm_xor_si128(shuffle(s2, t.shift[0][0]),
+                                       shuffle(s2, t.shift[0][1]));
+      const __m128i m1 = _mm_xor_si128(shuffle(s1, t.shift[0][1]),
+                                       shuffle(s1, t.shift[0][2]));
+      const __m128i m2 = _mm_xor_si128(shuffle(s1, t.shift[0][3]),
+                                       _mm_xor_si128(key(round), affine));
+      s = _mm_xor_si128(_mm_xor_si128(m0, m1), m2);
+    }
+    invert<false>(s, io, jo);
+    s = _mm_xor_si128(shuffle(lut2(t.enc_out[0], io, jo), t.shift[0][0]),
+                      _mm_xor_si128(key(Rounds), affine));
+  } else {
+    s = _mm_xor_si128(s, key(Rounds));
+#pragma GCC unroll 16
+    for (int round = Rounds - 1; round >= 1; --round) {
+      invert<true>(s, io, jo);
+      // 14*a_i ^ 11*a_(i+1) ^ 13*a_(i+2) ^ 9*a_(i+3) of the shifted rows
+      const __m128i m0 =
+          _mm_xor_si128(shuffle(lut2(t.dec_out[1], io, jo), t.shift[1][0]),
+                        shuffle(lut2(t.dec_out[2], io, jo), t.shift[1][1]));
+      const __m128i m1 =
+          _mm_xor_si128(shuffle(lut2(t.dec_out[3], io, jo), t.shift[1][2]),
+                        shuffle(lut2(t.dec_out[4], io, jo), t.shift[1][3]));
+      s = _mm_xor_si128(_mm_xor_si128(m0, m1), key(round));
+    }
+    invert<true>(s, io, jo);
+    s = _mm_xor_si128(shuffle(lut2(t.dec_out[0], io, jo), t.shift[1][0]),
+                      key(0));
+  }
+  _mm_storeu_si128((__m128i *)out, s);
+}
+
+} // namespace vperm
+
+/// @brief Constant-time single-stream software T-AES (SSSE3 pshufb). Meant
+/// for one or two blocks at a time, where bitslicing has nothing to batch;
+/// the bulk calls are a plain per-block loop with the usual counter tweaks.
+class AESVperm : public BulkCipher<AESVperm> {
+  friend class BulkCipher<AESVperm>;
+
+  int key_size;
+  int n_rounds;
+
+  // Expanded keys, shared read-only (same object AES and AESNI use)
+  shared_ptr<const KeySchedule> schedule;
+
+  static void check_cpu() {
+    if (!cpu_features().ssse3) {
+      throw runtime_error("CPU does not support SSSE3 instructions");
+    }
+  }
+
+  // One block with the fixed-size kernel for key_size; tweak_key is the
+  // tweak-round key in the form the direction uses (inverse for Decrypt)
+  template <bool Decrypt>
+  void crypt(const uint8_t *tweak_key, const uint8_t *in,
+             uint8_t *out) const {
+    dispatch_key_size(key_size, [&](auto bits) {
+      using Traits = KeyTraits<decltype(bits)::value>;
+      vperm::crypt_block<Traits::ROUNDS, Traits::TWEAK_ROUND, Decrypt>(
+          Decrypt ? schedule->dec : schedule->enc, tweak_key, in, out);
+    });
+  }
+
+  // Tweak-round key for an explicit tweak, in the form crypt<Decrypt> wants
+  template <bool Decrypt>
+  void tweak_key(const uint8_t *tweak, uint8_t *out) const {
+    KeySchedule::add_tweak(schedule->enc[schedule->tweak_round], tweak, out);
+    if (Decrypt)
+      vperm::inv_mix_key(out, out);
+  }
+
+  template <bool Decrypt>
+  vector<uint8_t> crypt_vector(const vector<uint8_t> &block,
+                               const uint8_t *tweak_key) const {
+    if (block.size() != 16) {
+      throw invalid_argument("Block must be exactly 16 bytes");
+    }
+    vector<uint8_t> result(16);
+    crypt<Decrypt>(tweak_key, block.data(), result.data());
+    return result;
+  }
+
+  template <bool Decrypt>
+  vector<uint8_t> crypt_vector(const vector<uint8_t> &block,
+                               const vector<uint8_t> &tweak) const {
+    if (tweak.size() != 16) {
+      throw invalid_argument("Tweak must be exactly 16 bytes");
+    }
+    uint8_t tweaked_key[16];
+    tweak_key<Decrypt>(tweak.data(), tweaked_key);
+    return crypt_vector<Decrypt>(block, tweaked_key);
+  }
+
+  template <bool Decrypt>
+  void process_blocks(const uint8_t *in, uint8_t *out, size_t nblocks,
+                      const uint8_t *tweak_start) const {
+    const int tr = schedule->tweak_round;
+    uint64_t hi = 0, lo = 0;
+    if (tweak_start)
+      KeySchedule::load_counter(tweak_start, hi, lo);
+    uint8_t tweaked_key[16];
+    memcpy(tweaked_key, Decrypt ? schedule->dec[tr] : schedule->enc[tr], 16);
+
+    dispatch_key_size(key_size, [&](auto bits) {
+      using Traits = KeyTraits<decltype(bits)::value>;
+      for (size_t i = 0; i < nblocks; ++i) {
+        if (tweak_start) {
+          KeySchedule::add_tweak_counter(schedule->enc[tr], hi, lo,
+                                         tweaked_key);
+          if (Decrypt)
+            vperm::inv_mix_key(tweaked_key, tweaked_key);
+          hi += (++lo == 0);
+        }
+        vperm::crypt_block<Traits::ROUNDS, Traits::TWEAK_ROUND, Decrypt>(
+            Decrypt ? schedule->dec : schedule->enc, tweaked_key, in + 16 * i,
+            out + 16 * i);
+      }
+    });
+  }
+
+public:
+  AESVperm(int size, int rounds, vector<uint8_t> key,
+           vector<uint8_t> tweak_key)
+      : key_size(size), n_rounds(KeySchedule::checked_rounds(size, rounds)),
+        schedule(make_schedule(size, key, tweak_key)) {}
+
+  /// @brief Expands key and tweak with the pshufb S-box, so key setup makes
+  /// no secret-dependent accesses either (AES::make_schedule uses the table)
+  /// @param size Key size in bits (128, 192 or 256)
+  /// @param key Key bytes (size / 8)
+  /// @param tweak_key 16-byte tweak, or empty for plain AES
+  /// @throws runtime_error if the CPU lacks SSSE3
+  static shared_ptr<const KeySchedule>
+  make_schedule(int size, const vector<uint8_t> &key,
+                const vector<uint8_t> &tweak_key) {
+    check_cpu();
+    return KeySchedule::expand(size, key, tweak_key, vperm::sub_word);
+  }
+
+  /// @brief Shares an existing schedule (no key setup work)
+  explicit AESVperm(shared_ptr<const KeySchedule> ks)
+      : key_size(ks->key_size), n_rounds(ks->n_rounds), schedule(move(ks)) {
+    check_cpu();
+  }
+
+  const shared_ptr<const KeySchedule> &key_schedule() const {
+    return schedule;
+  }
+
+  /// @brief Encrypts one 16-byte block under the schedule's tweak, without
+  /// allocating (latency path)
+  void encrypt_block(const uint8_t *in, uint8_t *out) const {
+    crypt<false>(schedule->tweaked_enc, in, out);
+  }
+
+  /// @brief Decrypts one 16-byte block under the schedule's tweak
+  void decrypt_block(const uint8_t *in, uint8_t *out) const {
+    crypt<true>(schedule->tweaked_dec, in, out);
+  }
+
+  /// @brief Encrypts one block under an explicit 16-byte tweak
+  void encrypt_block(const uint8_t *in, uint8_t *out,
+                     const uint8_t *tweak) const {
+    uint8_t tweaked_key[16];
+    tweak_key<false>(tweak, tweaked_key);
+    crypt<false>(tweaked_key, in, out);
+  }
+
+  /// @brief Decrypts one block under an explicit 16-byte tweak
+  void decrypt_block(const uint8_t *in, uint8_t *out,
+                     const uint8_t *tweak) const {
+    uint8_t tweaked_key[16];
+    tweak_key<true>(tweak, tweaked_key);
+    crypt<true>(tweaked_key, in, out);
+  }
+
+  /// @brief Encrypts a single 16-byte block
+  /// @param block vector<uint8_t> of exactly 16 bytes
+  /// @return Returns the encrypted block
+  vector<uint8_t> encrypt_block(const vector<uint8_t> &block) const {
+    return crypt_vector<false>(block, schedule->tweaked_enc);
+  }
+
+  /// @brief Decrypts a single 16-byte block
+  /// @param block vector<uint8_t> of exactly 16 bytes
+  /// @return Returns the decrypted block
+  vector<uint8_t> decrypt_block(const vector<uint8_t> &block) const {
+    return crypt_vector<true>(block, schedule->tweaked_dec);
+  }
+
+  /// @brief Encrypts one block under an explicit tweak, reusing the expanded
+  /// key: only the tweak-round key is recomputed (one 128-bit add)
+  vector<uint8_t> encrypt_block(const vector<uint8_t> &block,
+                                const vector<uint8_t> &tweak) const {
+    return crypt_vector<false>(block, tweak);
+  }
+
+  /// @brief Decrypts one block under an explicit tweak
+  vector<uint8_t> decrypt_block(const vector<uint8_t> &block,
+                                const vector<uint8_t> &tweak) const {
+    return crypt_vector<true>(block, tweak);
+  }
+
+};
@@ -0,0 +1,352 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <pthread.h>
+#include <random>
+#include <sched.h>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <time.h>
+#include <vector>
+#include <x86intrin.h>
+
+// Measurement harness for the speed benchmark. Every sample is one call of
+// the operation under test on a buffer prepared up front (inputs generated
+// once, contexts built once), timed with the TSC: lfence before the start
+// read, rdtscp + lfence at the end, so the region is neither entered early
+// nor left late by out-of-order execution. TSC ticks run at a fixed
+// reference rate (constant_tsc), calibrated against CLOCK_MONOTONIC once,
+// so samples convert to nanoseconds; cycles per byte are reference cycles,
+// which match core cycles only when the core runs at its base clock.
+//
+// throughput() is the multi-core counterpart: N threads pinned one per CPU
+// call their operation back to back for a fixed time, and the aggregate
+// rate is reported, which is what a pool of encryption workers gets.
+
+namespace bench {
+
+inline uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return uint64_t(ts.tv_sec) * 1000000000ULL + uint64_t(ts.tv_nsec);
+}
+
+/// @brief TSC read for the start of a timed region
+inline uint64_t ticks_begin() {
+  _mm_lfence();
+  return __rdtsc();
+}
+
+/// @brief TSC read for the end of a timed region (waits for it to retire)
+inline uint64_t ticks_end() {
+  unsigned aux;
+  const uint64_t t = __rdtscp(&aux);
+  _mm_lfence();
+  return t;
+}
+
+/// @brief TSC ticks per nanosecond, measured once over about 50 ms
+inline double tsc_ghz() {
+  static const double ghz = [] {
+    const uint64_t ns0 = now_ns(), t0 = ticks_begin();
+    uint64_t ns1;
+    while ((ns1 = now_ns()) - ns0 < 50000000) {
+    }
+    const uint64_t t1 = ticks_end();
+    return double(t1 - t0) / double(ns1 - ns0);
+  }();
+  return ghz;
+}
+
+/// @brief Fills buf with pseudo-random bytes (xorshift64*; the content
+/// only has to defeat compression and branch prediction, not be secret)
+inline void fill_random(uint8_t *buf, size_t len, uint64_t seed) {
+  uint64_t x = seed | 1;
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    const uint64_t v = x * 0x2545F4914F6CDD1DULL;
+    __builtin_memcpy(buf + i, &v, 8);
+  }
+  for (; i < len; ++i)
+    buf[i] = static_cast<uint8_t>(i * 131 + seed);
+}
+
+/// @brief Page-aligned buffer, untouched until first written
+class Buffer {
+public:
+  explicit Buffer(size_t size) : size_(size) {
+    void *p = nullptr;
+    if (posix_memalign(&p, 4096, std::max<size_t>(size, 1)) != 0)
+      throw std::runtime_error("Cannot allocate " + std::to_string(size) +
+                               " byte buffer");
+    data_ = static_cast<uint8_t *>(p);
+  }
+  Buffer(const Buffer &) = delete;
+  Buffer &operator=(const Buffer &) = delete;
+  ~Buffer() { free(data_); }
+
+  uint8_t *data() const { return data_; }
+  size_t size() const { return size_; }
+
+private:
+  uint8_t *data_ = nullptr;
+  size_t size_ = 0;
+};
+
+/// @brief How long to measure one case
+struct Config {
+  double min_time = 0.2;        // seconds of samples per case, at least
+  size_t min_iters = 5;         // samples per case, at least
+  size_t max_iters = 100000;    // samples per case, at most
+  double warmup_time = 0.05;    // seconds of untimed calls first
+  size_t warmup_iters = 2;      // untimed calls first, at least
+};
+
+/// @brief Distribution of one case's samples, in nanoseconds
+struct Stats {
+  size_t n = 0;
+  double min = 0, max = 0, mean = 0, stddev = 0;
+  double p50 = 0, p90 = 0, p99 = 0, p999 = 0;
+  double median_ticks = 0; // p50 in TSC ticks, for cycles per byte
+  double p50_lo = 0, p50_hi = 0;  // 95% confidence interval of p50
+  std::vector<double> percentiles; // 0th, 1st, ... 100th
+
+  /// @brief Nearest-rank percentile q (0..1) of sorted samples
+  static double percentile(const std::vector<uint64_t> &sorted, double q) {
+    const size_t rank = static_cast<size_t>(std::ceil(q * sorted.size()));
+    return double(sorted[std::min(sorted.size() - 1, rank ? rank - 1 : 0)]);
+  }
+
+  /// @brief Distribution-free 95% confidence interval of the median of
+  /// sorted samples: the order statistics at ranks n/2 -+ 1.96 sqrt(n)/2
+  /// (normal approximation of the binomial), clamped to the sample
+  static void median_ci(const std::vector<uint64_t> &sorted, double &lo,
+                        double &hi) {
+    const double n = double(sorted.size());
+    const double half = 1.96 * std::sqrt(n) / 2;
+    const double j = std::max(1.0, std::floor(n / 2 - half));
+    const double k = std::min(n, std::ceil(n / 2 + 1 + half));
+    lo = double(sorted[size_t(j) - 1]);
+    hi = double(sorted[size_t(k) - 1]);
+  }
+
+  /// @brief Summarizes TSC tick samples (sorts them)
+  static Stats of(std::vector<uint64_t> &ticks) {
+    Stats s;
+    if (ticks.empty())
+      return s;
+    std::sort(ticks.begin(), ticks.end());
+    const double to_ns = 1.0 / tsc_ghz();
+    s.n = ticks.size();
+    double sum = 0, sq = 0;
+    for (uint64_t t : ticks) {
+      sum += double(t);
+      sq += double(t) * double(t);
+    }
+    const double mean = sum / s.n;
+    const double var = s.n > 1 ? (sq - sum * mean) / (s.n - 1) : 0;
+    s.mean = mean * to_ns;
+    s.stddev = std::sqrt(std::max(var, 0.0)) * to_ns;
+    s.min = double(ticks.front()) * to_ns;
+    s.max = double(ticks.back()) * to_ns;
+    s.median_ticks = percentile(ticks, 0.5);
+    s.p50 = s.median_ticks * to_ns;
+    s.p90 = percentile(ticks, 0.9) * to_ns;
+    s.p99 = percentile(ticks, 0.99) * to_ns;
+    s.p999 = percentile(ticks, 0.999) * to_ns;
+    median_ci(ticks, s.p50_lo, s.p50_hi);
+    s.p50_lo *= to_ns;
+    s.p50_hi *= to_ns;
+    for (int q = 0; q <= 100; ++q)
+      s.percentiles.push_back(percentile(ticks, q / 100.0) * to_ns);
+    return s;
+  }
+};
+
+/// @brief 95% bootstrap confidence interval of the median of values, e.g.
+/// the medians of independent runs: resampled with replacement (fixed
+/// seed, so a report is reproducible) and the 2.5th and 97.5th percentiles
+/// of the resampled medians taken. Unlike Stats::median_ci this covers the
+/// noise between runs (frequency, placement, neighbours), not just within
+/// one; it never extends past the smallest or largest value
+inline void bootstrap_median_ci(const std::vector<double> &values, double &lo,
+                                double &hi, unsigned resamples = 2000) {
+  if (values.empty()) {
+    lo = hi = 0;
+    return;
+  }
+  std::mt19937_64 rng(0x5eed);
+  std::uniform_int_distribution<size_t> pick(0, values.size() - 1);
+  std::vector<double> draw(values.size()), medians(resamples);
+  for (double &m : medians) {
+    for (double &d : draw)
+      d = values[pick(rng)];
+    const size_t mid = draw.size() / 2;
+    std::nth_element(draw.begin(), draw.begin() + mid, draw.end());
+    m = draw[mid];
+    if (draw.size() % 2 == 0)
+      m = (m + *std::max_element(draw.begin(), draw.begin() + mid)) / 2;
+  }
+  std::sort(medians.begin(), medians.end());
+  lo = medians[size_t(0.025 * (resamples - 1))];
+  hi = medians[size_t(0.975 * (resamples - 1))];
+}
+
+/// @brief Untimed calls of op, to fault in buffers and settle clocks
+template <typename Op> void warmup(Op &&op, const Config &cfg) {
+  const uint64_t warm_end = now_ns() + uint64_t(cfg.warmup_time * 1e9);
+  for (size_t i = 0; i < cfg.warmup_iters || now_ns() < warm_end; ++i)
+    op();
+}
+
+/// @brief Times one call of op per sample until the Config limits are met
+/// @return TSC ticks per call
+template <typename Op>
+std::vector<uint64_t> sample(Op &&op, const Config &cfg) {
+  std::vector<uint64_t> ticks;
+  ticks.reserve(std::min<size_t>(cfg.max_iters, 1 << 16));
+  const uint64_t budget = uint64_t(cfg.min_time * 1e9 * tsc_ghz());
+  uint64_t spent = 0;
+  while (ticks.size() < cfg.max_iters &&
+         (ticks.size() < cfg.min_iters || spent < budget)) {
+    const uint64_t t0 = ticks_begin();
+    op();
+    const uint64_t t = ticks_end() - t0;
+    ticks.push_back(t);
+    spent += t;
+  }
+  return ticks;
+}
+
+/// @brief warmup() then sample()
+template <typename Op>
+std::vector<uint64_t> measure(Op &&op, const Config &cfg) {
+  warmup(op, cfg);
+  return sample(op, cfg);
+}
+
+/// @brief CPUs the process may run on, in ascending order
+inline std::vector<int> allowed_cpus() {
+  std::vector<int> cpus;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0)
+    for (int c = 0; c < CPU_SETSIZE; ++c)
+      if (CPU_ISSET(c, &set))
+        cpus.push_back(c);
+  if (cpus.empty())
+    cpus.push_back(0);
+  return cpus;
+}
+
+/// @brief Pins the calling thread to one CPU
+/// @return false if the affinity could not be set
+inline bool pin_to(int cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+/// @brief Aggregate throughput of threads workers. Worker t is pinned to
+/// cpus[t % cpus.size()], then builds its operation with make_op(t) (so
+/// private state is first touched on its own core), fills a private buffer
+/// of size bytes, warms up, and calls op(buffer, size) back to back for
+/// seconds once every worker is ready
+/// @return Bytes per nanosecond (GB/s) over all workers
+template <typename MakeOp>
+double throughput(unsigned threads, size_t size, double seconds,
+                  double warmup, const std::vector<int> &cpus,
+                  MakeOp make_op) {
+  std::atomic<unsigned> ready{0};
+  std::atomic<bool> go{false}, stop{false};
+  std::vector<uint64_t> calls(threads), end_ns(threads);
+
+  auto worker = [&](unsigned t) {
+    pin_to(cpus[t % cpus.size()]);
+    auto op = make_op(t);
+    Buffer buf(size);
+    fill_random(buf.data(), size, size + t);
+    const uint64_t warm_end = now_ns() + uint64_t(warmup * 1e9);
+    do
+      op(buf.data(), size);
+    while (now_ns() < warm_end);
+
+    ready.fetch_add(1);
+    while (!go.load(std::memory_order_acquire))
+      std::this_thread::yield();
+    uint64_t n = 0;
+    while (!stop.load(std::memory_order_relaxed)) {
+      op(buf.data(), size);
+      ++n;
+    }
+    calls[t] = n;
+    end_ns[t] = now_ns();
+  };
+
+  std::vector<std::thread> pool;
+  for (unsigned t = 0; t < threads; ++t)
+    pool.emplace_back(worker, t);
+  while (ready.load() < threads)
+    std::this_thread::yield();
+  const uint64_t start = now_ns();
+  go.store(true, std::memory_order_release);
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  stop.store(true);
+  for (auto &th : pool)
+    th.join();
+
+  // Calls still running at the stop count, so the window ends at the last
+  uint64_t bytes = 0, end = start + 1;
+  for (unsigned t = 0; t < threads; ++t) {
+    bytes += calls[t] * size;
+    end = std::max(end, end_ns[t]);
+  }
+  return double(bytes) / double(end - start);
+}
+
+/// @brief Parses a byte count with an optional K, M or G (binary) suffix
+/// @return false for anything else
+inline bool parse_size(const std::string &text, size_t &out) {
+  char *end = nullptr;
+  const unsigned long long v = strtoull(text.c_str(), &end, 10);
+  if (text.empty() || text[0] == '-' || end == text.c_str())
+    return false;
+  unsigned shift = 0;
+  const std::string suffix = end;
+  if (suffix == "K" || suffix == "k")
+    shift = 10;
+  else if (suffix == "M" || suffix == "m")
+    shift = 20;
+  else if (suffix == "G" || suffix == "g")
+    shift = 30;
+  else if (!suffix.empty())
+    return false;
+  if (v > (SIZE_MAX >> shift))
+    return false;
+  out = size_t(v) << shift;
+  return true;
+}
+
+/// @brief Human-readable byte count (16 B, 4 KiB, 1 GiB, ...)
+inline std::string format_size(size_t size) {
+  const char *units[] = {"B", "KiB", "MiB", "GiB"};
+  unsigned u = 0;
+  while (u < 3 && size >= 1024 && size % 1024 == 0) {
+    size /= 1024;
+    ++u;
+  }
+  return std::to_string(size) + " " + units[u];
+}
+
+} // namespace bench
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+// Runtime CPU feature probing for kernel dispatch.
+// The binaries are built for the AES-NI + SSE4.1 baseline; wider kernels are
+// compiled with per-function target attributes and only selected here when
+// both the CPU and the OS (XSAVE state) support them.
+
+#define cpuid_count(func, subfunc, ax, bx, cx, dx)                             \
+  __asm__ __volatile__("cpuid"                                                 \
+                       : "=a"(ax), "=b"(bx), "=c"(cx), "=d"(dx)                \
+                       : "a"(func), "c"(subfunc));
+
+struct CPUFeatures {
+  bool aesni = false;
+  bool pclmulqdq = false;
+  bool ssse3 = false;
+  bool avx2 = false;
+  bool vaes = false;
+  bool vpclmulqdq = false;
+  bool avx512f = false;
+  bool os_ymm = false; // OS saves YMM state (XCR0 bits 1-2)
+  bool os_zmm = false; // OS saves ZMM/opmask state (XCR0 bits 5-7)
+};
+
+// AES kernels in order of width; the dispatcher picks the widest supported
+enum class AESKernel { AESNI = 0, VAES256 = 1, VAES512 = 2 };
+
+inline CPUFeatures probe_cpu_features() {
+  CPUFeatures f;
+  unsigned int a, b, c, d;
+
+  cpuid_count(0, 0, a, b, c, d);
+  unsigned int max_leaf = a;
+
+  cpuid_count(1, 0, a, b, c, d);
+  f.pclmulqdq = c & (1u << 1);
+  f.ssse3 = c & (1u << 9);
+  f.aesni = c & (1u << 25);
+  bool osxsave = c & (1u << 27);
+  bool avx = c & (1u << 28);
+
+  if (osxsave) {
+    unsigned int xcr0_lo, xcr0_hi;
+    __asm__ __volatile__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    f.os_ymm = avx && (xcr0_lo & 0x6) == 0x6;
+    f.os_zmm = f.os_ymm && (xcr0_lo & 0xE0) == 0xE0;
+  }
+
+  if (max_leaf >= 7) {
+    cpuid_count(7, 0, a, b, c, d);
+    f.avx2 = f.os_ymm && (b & (1u << 5));
+    f.avx512f = f.os_zmm && (b & (1u << 16));
+    f.vaes = f.os_ymm && (c & (1u << 9));
+    f.vpclmulqdq = f.os_ymm && (c & (1u << 10));
+  }
+  return f;
+}
+
+/// @brief CPU features, probed once on first use
+inline const CPUFeatures &cpu_features() {
+  static const CPUFeatures features = probe_cpu_features();
+  return features;
+}
+
+inline const char *aes_kernel_name(AESKernel kernel) {
+  switch (kernel) {
+  case AESKernel::VAES512:
+    return "vaes512";
+  case AESKernel::VAES256:
+    return "vaes256";
+  default:
+    return "aesni";
+  }
+}
+
+/// @brief Picks the widest AES kernel the host supports, once per process
+/// @note TAES_KERNEL=aesni|vaes256|vaes512 caps the choice (benchmarks and
+/// tests use it to exercise the narrower paths on wide hosts)
+inline AESKernel best_aes_kernel() {
+  static const AESKernel kernel = [] {
+    const CPUFeatures &f = cpu_features();
+    AESKernel best = AESKernel::AESNI;
+    if (f.aesni && f.vaes && f.avx2)
+      best = AESKernel::VAES256;
+    if (f.aesni && f.vaes && f.avx512f)
+      best = AESKernel::VAES512;
+
+    if (const char *forced = getenv("TAES_KERNEL")) {
+      AESKernel cap = best;
+      if (strcmp(forced, "aesni") == 0)
+        cap = AESKernel::AESNI;
+      else if (strcmp(forced, "vaes256") == 0)
+        cap = AESKernel::VAES256;
+      if (static_cast<int>(cap) < static_cast<int>(best))
+        best = cap;
+    }
+    return best;
+  }();
+  return kernel;
+}
+
+inline std::string cpu_features_string() {
+  const CPUFeatures &f = cpu_features();
+  std::string s;
+  auto add = [&](bool on, const char *name) {
+    if (on) {
+      if (!s.empty())
+        s += ' ';
+      s += name;
+    }
+  };
+  add(f.aesni, "aes");
+  add(f.pclmulqdq, "pclmulqdq");
+  add(f.ssse3, "ssse3");
+  add(f.avx2, "avx2");
+  add(f.vaes, "vaes");
+  add(f.vpclmulqdq, "vpclmulqdq");
+  add(f.avx512f, "avx512f");
+  return s;
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+// Ciphertext stealing over any engine with the bulk interface
+// encrypt_blocks/decrypt_blocks(in, out, nblocks, const uint8_t *tweak).
+// Messages of 16 bytes or more keep their exact length: the last partial
+// block Pn is completed with the tail of C(n-1), encrypted with the next
+// tweak, and C(n-1) is truncated, so the output is
+//   C0 .. C(n-2) | first |Pn| bytes of C(n-1) | Cn
+// Everything runs on the caller's buffers plus two stack blocks: out may be
+// the same buffer as in (in-place), other overlaps are not supported.
+// Since block i only depends on tweak + i, decrypt_range recovers any byte
+// range of a message from the blocks covering it alone.
+
+namespace cts {
+
+/// @brief out = tweak + n, the tweak of block n (128-bit big-endian counter)
+inline void tweak_at(const uint8_t *tweak, uint64_t n, uint8_t *out) {
+  uint64_t be_hi, be_lo;
+  memcpy(&be_hi, tweak, 8);
+  memcpy(&be_lo, tweak + 8, 8);
+  uint64_t hi = __builtin_bswap64(be_hi), lo = __builtin_bswap64(be_lo);
+  lo += n;
+  hi += (lo < n);
+  be_hi = __builtin_bswap64(hi);
+  be_lo = __builtin_bswap64(lo);
+  memcpy(out, &be_hi, 8);
+  memcpy(out + 8, &be_lo, 8);
+}
+
+inline void check_length(size_t len) {
+  if (len != 0 && len < 16) {
+    throw std::invalid_argument(
+        "Ciphertext stealing needs at least 16 bytes of input");
+  }
+}
+
+/// @brief Encrypts len bytes (0 or >= 16) with ciphertext stealing
+/// @param tweak Tweak of block 0 (block i uses tweak + i), nullptr for none
+template <typename Cipher>
+void encrypt(const Cipher &aes, const uint8_t *in, uint8_t *out, size_t len,
+             const uint8_t *tweak) {
+  check_length(len);
+  const size_t full_blocks = len / 16;
+  const size_t partial = len % 16;
+
+  aes.encrypt_blocks(in, out, full_blocks, tweak);
+
+  if (partial != 0) {
+    // Pn is read before Cn overwrites it (in-place)
+    uint8_t *cn1 = out + 16 * (full_blocks - 1);
+    uint8_t last_block[16];
+    memcpy(last_block, in + 16 * full_blocks, partial);
+    memcpy(last_block + partial, cn1 + partial, 16 - partial);
+
+    uint8_t last_tweak[16];
+    if (tweak)
+      tweak_at(tweak, full_blocks, last_tweak);
+    // Cn is written right after the truncated C(n-1)
+    aes.encrypt_blocks(last_block, cn1 + partial, 1,
+                       tweak ? last_tweak : nullptr);
+  }
+}
+
+/// @brief Decrypts len bytes (0 or >= 16) produced by cts::encrypt
+/// @param tweak Tweak of block 0 (block i uses tweak + i), nullptr for none
+template <typename Cipher>
+void decrypt(const Cipher &aes, const uint8_t *in, uint8_t *out, size_t len,
+             const uint8_t *tweak) {
+  check_length(len);
+  const size_t full_blocks = len / 16;
+  const size_t partial = len % 16;
+
+  // With stealing the last full block and the partial one are merged
+  const size_t bulk_blocks = partial != 0 ? full_blocks - 1 : full_blocks;
+  aes.decrypt_blocks(in, out, bulk_blocks, tweak);
+
+  if (partial != 0) {
+    const uint8_t *cn1_head = in + 16 * bulk_blocks;
+    const uint8_t *cn = cn1_head + partial;
+    uint8_t block_tweak[16];
+
+    // Cn (tweak + n) gives Pn followed by the stolen tail of C(n-1)
+    if (tweak)
+      tweak_at(tweak, full_blocks, block_tweak);
+    uint8_t decrypted_cn[16];
+    aes.decrypt_blocks(cn, decrypted_cn, 1, tweak ? block_tweak : nullptr);
+
+    uint8_t full_cn1[16];
+    memcpy(full_cn1, cn1_head, partial);
+    memcpy(full_cn1 + partial, decrypted_cn + partial, 16 - partial);
+
+    // C(n-1) (tweak + n - 1), then Pn
+    if (tweak)
+      tweak_at(tweak, bulk_blocks, block_tweak);
+    aes.decrypt_blocks(full_cn1, out + 16 * bulk_blocks, 1,
+                       tweak ? block_tweak : nullptr);
+    memcpy(out + 16 * bulk_blocks + 16, decrypted_cn, partial);
+  }
+}
+
+/// @brief Decrypts bytes [offset, offset + count) of a len byte message
+/// produced by cts::encrypt, reading only the blocks that cover them (and
+/// the last two, decrypted as one unit, when the range reaches the tail
+/// they share through stealing)
+/// @param in The whole ciphertext, e.g. a mapping of the file
+/// @param out count bytes
+/// @param tweak Tweak of block 0 (block i uses tweak + i), nullptr for none
+/// @throws std::out_of_range if the range does not lie within the message
+template <typename Cipher>
+void decrypt_range(const Cipher &aes, const uint8_t *in, size_t len,
+                   size_t offset, size_t count, uint8_t *out,
+                   const uint8_t *tweak) {
+  check_length(len);
+  if (offset > len || count > len - offset)
+    throw std::out_of_range("Range lies outside the message");
+  const size_t full_blocks = len / 16;
+  const size_t partial = len % 16;
+  // With stealing, the last full block and the partial one go together
+  const size_t tail = partial != 0 ? 16 * (full_blocks - 1) : len;
+  const size_t end = offset + count;
+
+  uint8_t block_tweak[16];
+  auto tweak_of = [&](size_t block) -> const uint8_t * {
+    if (!tweak)
+      return nullptr;
+    tweak_at(tweak, block, block_tweak);
+    return block_tweak;
+  };
+
+  uint8_t block[32];
+  size_t pos = offset;
+  const size_t plain_end = std::min(end, tail);
+  while (pos < plain_end) {
+    const size_t skip = pos % 16;
+    if (skip == 0 && plain_end - pos >= 16) {
+      // Whole blocks straight into out
+      const size_t n = (plain_end - pos) / 16;
+      aes.decrypt_blocks(in + pos, out + (pos - offset), n, tweak_of(pos / 16));
+      pos += 16 * n;
+    } else {
+      // A block cut by the range boundary
+      aes.decrypt_blocks(in + pos - skip, block, 1, tweak_of(pos / 16));
+      const size_t take = std::min<size_t>(16 - skip, plain_end - pos);
+      memcpy(out + (pos - offset), block + skip, take);
+      pos += take;
+    }
+  }
+
+  if (end > tail) {
+    decrypt(aes, in + tail, block, len - tail, tweak_of(tail / 16));
+    memcpy(out + (pos - offset), block + (pos - tail), end - pos);
+  }
+}
+
+} // namespace cts
@@ -0,0 +1,340 @@
+#pragma once
+
+#include "CTS.hpp"
+#include "FdIO.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Chunked container (--container): a self-describing wrapper around the
+// ciphertext for data that is read back piecewise or on many cores.
+//
+//   header  32 B  magic "TAESCHK1", u16 key bits, u16 flags (1: tweaked),
+//                 u32 chunk size, 16 B tweak base (zero when untweaked)
+//   frames        one per chunk: u32 ciphertext length, then the ciphertext
+//   end      4 B  u32 0
+//   index         u64 file offset of every frame, in chunk order
+//   footer  24 B  u64 index offset, u64 chunk count, magic "TAESIDX1"
+//
+// Integers are little-endian. Chunk k holds plaintext bytes from
+// k * chunk_size and is encrypted as a message of its own, with its own
+// ciphertext stealing, starting at tweak base + k * chunk_size / 16. A last
+// piece of 1..15 bytes joins the chunk before it, so only the last chunk
+// steals (it may reach chunk_size + 15 bytes) and the frame payloads put
+// together are exactly the bare ciphertext. The writer emits each frame as
+// soon as its chunk is full and appends the index at the end, so it never
+// seeks and can write to a pipe; readers stream the frames, or use the
+// footer and index to decrypt any chunk, or all of them on several threads.
+
+namespace container {
+
+constexpr size_t HEADER_SIZE = 32;
+constexpr size_t FRAME_SIZE = 4; // length prefix
+constexpr size_t FOOTER_SIZE = 24;
+constexpr size_t MAX_CHUNK = size_t(1) << 30;
+constexpr uint16_t FLAG_TWEAKED = 1;
+constexpr char MAGIC[8] = {'T', 'A', 'E', 'S', 'C', 'H', 'K', '1'};
+constexpr char INDEX_MAGIC[8] = {'T', 'A', 'E', 'S', 'I', 'D', 'X', '1'};
+
+inline void put_le(uint8_t *p, uint64_t v, unsigned bytes) {
+  for (unsigned i = 0; i < bytes; ++i)
+    p[i] = static_cast<uint8_t>(v >> (8 * i));
+}
+
+inline uint64_t get_le(const uint8_t *p, unsigned bytes) {
+  uint64_t v = 0;
+  for (unsigned i = 0; i < bytes; ++i)
+    v |= uint64_t(p[i]) << (8 * i);
+  return v;
+}
+
+/// @brief Throws std::invalid_argument unless chunk_size is a multiple of
+/// 16 from 16 bytes to 1 GiB
+inline void check_chunk_size(size_t chunk_size) {
+  if (chunk_size < 16 || chunk_size > MAX_CHUNK || chunk_size % 16 != 0)
+    throw std::invalid_argument(
+        "Chunk size must be a multiple of 16 from 16 bytes to 1 GiB");
+}
+
+/// @brief Decoded container header
+struct Header {
+  unsigned key_size = 0; // 128, 192 or 256
+  bool tweaked = false;
+  uint32_t chunk_size = 0;
+  uint8_t tweak[16] = {};
+
+  /// @return Tweak base, nullptr for an untweaked container
+  const uint8_t *tweak_ptr() const { return tweaked ? tweak : nullptr; }
+
+  void encode(uint8_t *out) const {
+    memcpy(out, MAGIC, 8);
+    put_le(out + 8, key_size, 2);
+    put_le(out + 10, tweaked ? FLAG_TWEAKED : 0, 2);
+    put_le(out + 12, chunk_size, 4);
+    memcpy(out + 16, tweak, 16);
+  }
+
+  /// @throws std::runtime_error for anything but a valid header
+  static Header decode(const uint8_t *in) {
+    if (memcmp(in, MAGIC, 8) != 0)
+      throw std::runtime_error("Not a T-AES container");
+    Header h;
+    h.key_size = static_cast<unsigned>(get_le(in + 8, 2));
+    const uint64_t flags = get_le(in + 10, 2);
+    h.chunk_size = static_cast<uint32_t>(get_le(in + 12, 4));
+    if ((h.key_size != 128 && h.key_size != 192 && h.key_size != 256) ||
+        (flags & ~uint64_t(FLAG_TWEAKED)) != 0 || h.chunk_size < 16 ||
+        h.chunk_size > MAX_CHUNK || h.chunk_size % 16 != 0)
+      throw std::runtime_error("Unsupported container header");
+    h.tweaked = flags & FLAG_TWEAKED;
+    memcpy(h.tweak, in + 16, 16);
+    return h;
+  }
+};
+
+/// @brief Checks that aes can open the container and picks the tweak base
+/// @param tweak The caller's tweak, nullptr for none: then the one stored
+/// in the header is used
+/// @return Tweak base for the chunks, nullptr when untweaked
+/// @throws std::runtime_error on a key size or tweak mismatch
+template <typename Cipher>
+const uint8_t *resolve_tweak(const Header &h, const Cipher &aes,
+                             const uint8_t *tweak) {
+  const int key_size = aes.key_schedule()->key_size;
+  if (static_cast<unsigned>(key_size) != h.key_size)
+    throw std::runtime_error("Container was written with AES-" +
+                             std::to_string(h.key_size));
+  if (tweak && (!h.tweaked || memcmp(tweak, h.tweak, 16) != 0))
+    throw std::runtime_error("Tweak does not match the container");
+  return h.tweak_ptr();
+}
+
+/// @brief Encrypts (or decrypts) chunk k of len bytes in place
+template <bool Decrypt, typename Cipher>
+void crypt_chunk(const Cipher &aes, uint8_t *buf, size_t len, uint64_t k,
+                 uint32_t chunk_size, const uint8_t *tweak) {
+  uint8_t chunk_tweak[16];
+  if (tweak)
+    cts::tweak_at(tweak, k * (chunk_size / 16), chunk_tweak);
+  if (Decrypt)
+    aes.decrypt(buf, buf, len, tweak ? chunk_tweak : nullptr);
+  else
+    aes.encrypt(buf, buf, len, tweak ? chunk_tweak : nullptr);
+}
+
+/// @brief Encrypts in_fd until EOF into a container on out_fd, writing
+/// each frame as soon as its chunk is complete
+/// @param tweak Tweak base, nullptr for none
+/// @throws std::invalid_argument for a bad chunk size or 1..15 bytes of
+/// input (nothing is written then), std::runtime_error on I/O errors
+template <typename Cipher>
+void write(const Cipher &aes, int in_fd, int out_fd, const uint8_t *tweak,
+           size_t chunk_size) {
+  check_chunk_size(chunk_size);
+  // One chunk plus the 16 bytes read past it to see whether input is left
+  std::vector<uint8_t> buf(chunk_size + 16);
+  size_t have = stream_io::read_full(in_fd, buf.data(), chunk_size);
+  cts::check_length(have);
+
+  Header h;
+  h.key_size = static_cast<unsigned>(aes.key_schedule()->key_size);
+  h.tweaked = tweak != nullptr;
+  h.chunk_size = static_cast<uint32_t>(chunk_size);
+  if (tweak)
+    memcpy(h.tweak, tweak, 16);
+  uint8_t header[HEADER_SIZE];
+  h.encode(header);
+  stream_io::write_all(out_fd, header, HEADER_SIZE);
+
+  std::vector<uint64_t> offsets;
+  uint64_t pos = HEADER_SIZE;
+  for (uint64_t k = 0; have != 0; ++k) {
+    size_t len = have;
+    bool last = have < chunk_size;
+    if (!last) {
+      const size_t extra =
+          stream_io::read_full(in_fd, buf.data() + chunk_size, 16);
+      if (extra < 16) {
+        len += extra; // 0..15 bytes left: they belong to this chunk
+        last = true;
+      }
+    }
+    crypt_chunk<false>(aes, buf.data(), len, k, h.chunk_size, tweak);
+    uint8_t frame[FRAME_SIZE];
+    put_le(frame, len, FRAME_SIZE);
+    stream_io::write_all(out_fd, frame, FRAME_SIZE);
+    stream_io::write_all(out_fd, buf.data(), len);
+    offsets.push_back(pos);
+    pos += FRAME_SIZE + len;
+    if (last)
+      break;
+    memcpy(buf.data(), buf.data() + chunk_size, 16);
+    have = 16 + stream_io::read_full(in_fd, buf.data() + 16, chunk_size - 16);
+  }
+
+  // End marker, index and footer
+  std::vector<uint8_t> tail(FRAME_SIZE + 8 * offsets.size() + FOOTER_SIZE);
+  uint8_t *p = tail.data() + FRAME_SIZE; // end marker: length 0
+  for (uint64_t offset : offsets) {
+    put_le(p, offset, 8);
+    p += 8;
+  }
+  put_le(p, pos + FRAME_SIZE, 8);
+  put_le(p + 8, offsets.size(), 8);
+  memcpy(p + 16, INDEX_MAGIC, 8);
+  stream_io::write_all(out_fd, tail.data(), tail.size());
+}
+
+/// @brief Decrypts a container read sequentially from in_fd (a pipe is
+/// fine) to out_fd; the index is not needed and left unread
+/// @param tweak Caller's tweak, nullptr to use the header's
+/// @throws std::runtime_error for a damaged or mismatching container
+template <typename Cipher>
+void read_stream(const Cipher &aes, int in_fd, int out_fd,
+                 const uint8_t *tweak) {
+  uint8_t header[HEADER_SIZE];
+  if (stream_io::read_full(in_fd, header, HEADER_SIZE) != HEADER_SIZE)
+    throw std::runtime_error("Not a T-AES container");
+  const Header h = Header::decode(header);
+  const uint8_t *base = resolve_tweak(h, aes, tweak);
+
+  std::vector<uint8_t> buf(h.chunk_size + 15);
+  size_t prev = h.chunk_size;
+  for (uint64_t k = 0;; ++k) {
+    uint8_t frame[FRAME_SIZE];
+    if (stream_io::read_full(in_fd, frame, FRAME_SIZE) != FRAME_SIZE)
+      throw std::runtime_error("Truncated container");
+    const size_t len = get_le(frame, FRAME_SIZE);
+    if (len == 0)
+      break;
+    // Every chunk but the last is exactly chunk_size bytes
+    if (prev != h.chunk_size || len < 16 || len > buf.size())
+      throw std::runtime_error("Corrupt container chunk");
+    if (stream_io::read_full(in_fd, buf.data(), len) != len)
+      throw std::runtime_error("Truncated container");
+    crypt_chunk<true>(aes, buf.data(), len, k, h.chunk_size, base);
+    stream_io::write_all(out_fd, buf.data(), len);
+    prev = len;
+  }
+}
+
+/// @brief Random access to a container held in memory (an mmap'd file):
+/// the constructor validates the header, footer, index and frame layout
+class Reader {
+public:
+  /// @throws std::runtime_error for a damaged container
+  Reader(const uint8_t *data, size_t size) : data_(data) {
+    if (size < HEADER_SIZE + FRAME_SIZE + FOOTER_SIZE)
+      throw std::runtime_error("Not a T-AES container");
+    header_ = Header::decode(data);
+    const uint8_t *footer = data + size - FOOTER_SIZE;
+    const uint64_t index = get_le(footer, 8);
+    const uint64_t count = get_le(footer + 8, 8);
+    if (memcmp(footer + 16, INDEX_MAGIC, 8) != 0 ||
+        index < HEADER_SIZE + FRAME_SIZE || index > size - FOOTER_SIZE ||
+        (size - FOOTER_SIZE - index) / 8 != count ||
+        (size - FOOTER_SIZE - index) % 8 != 0 ||
+        get_le(data + index - FRAME_SIZE, FRAME_SIZE) != 0)
+      throw std::runtime_error("Corrupt container index");
+
+    // Frames must follow each other from the header to the end marker
+    offsets_.resize(count);
+    uint64_t pos = HEADER_SIZE;
+    const size_t chunk = header_.chunk_size;
+    for (uint64_t k = 0; k < count; ++k) {
+      offsets_[k] = get_le(data + index + 8 * k, 8);
+      if (offsets_[k] != pos || pos + FRAME_SIZE > index - FRAME_SIZE)
+        throw std::runtime_error("Corrupt container index");
+      const uint64_t len = get_le(data + pos, FRAME_SIZE);
+      const bool last = k + 1 == count;
+      if (last ? len < 16 || len > chunk + 15 : len != chunk)
+        throw std::runtime_error("Corrupt container chunk");
+      pos += FRAME_SIZE + len;
+    }
+    if (pos != index - FRAME_SIZE)
+      throw std::runtime_error("Corrupt container index");
+    last_len_ = count ? get_le(data + offsets_.back(), FRAME_SIZE) : 0;
+  }
+
+  const Header &header() const { return header_; }
+  uint64_t chunk_count() const { return offsets_.size(); }
+
+  /// @return Plaintext bytes of chunk k
+  size_t chunk_length(uint64_t k) const {
+    return k + 1 == offsets_.size() ? last_len_ : header_.chunk_size;
+  }
+
+  /// @return Offset of chunk k in the plaintext
+  uint64_t chunk_offset(uint64_t k) const { return k * header_.chunk_size; }
+
+  uint64_t plaintext_size() const {
+    return offsets_.empty() ? 0 : chunk_offset(offsets_.size() - 1) + last_len_;
+  }
+
+  /// @brief Decrypts chunk k into out (chunk_length(k) bytes)
+  /// @param tweak Tweak base from resolve_tweak
+  /// @throws std::out_of_range for a chunk past the end
+  template <typename Cipher>
+  void decrypt_chunk(const Cipher &aes, uint64_t k, uint8_t *out,
+                     const uint8_t *tweak) const {
+    if (k >= offsets_.size())
+      throw std::out_of_range("Chunk number past the end of the container");
+    const size_t len = chunk_length(k);
+    memcpy(out, data_ + offsets_[k] + FRAME_SIZE, len);
+    crypt_chunk<true>(aes, out, len, k, header_.chunk_size, tweak);
+  }
+
+  /// @brief Decrypts every chunk into out (plaintext_size() bytes) with up
+  /// to jobs threads, each claiming the next chunk with its own engine copy
+  template <typename Cipher>
+  void decrypt_all(const Cipher &aes, uint8_t *out, const uint8_t *tweak,
+                   unsigned jobs) const {
+    const uint64_t count = offsets_.size();
+    const unsigned workers = static_cast<unsigned>(
+        std::max<uint64_t>(1, std::min<uint64_t>(std::max(jobs, 1u), count)));
+    std::atomic<uint64_t> next{0};
+    auto work = [&] {
+      const Cipher local(aes); // own context, shared key schedule
+      for (uint64_t k; (k = next.fetch_add(1)) < count;)
+        decrypt_chunk(local, k, out + chunk_offset(k), tweak);
+    };
+
+    std::vector<std::exception_ptr> errors(workers);
+    std::vector<std::thread> threads;
+    threads.reserve(workers - 1);
+    for (unsigned w = 0; w + 1 < workers; ++w) {
+      threads.emplace_back([&, w] {
+        try {
+          work();
+        } catch (...) {
+          errors[w] = std::current_exception();
+        }
+      });
+    }
+    try {
+      work();
+    } catch (...) {
+      errors[workers - 1] = std::current_exception();
+    }
+    for (auto &t : threads)
+      t.join();
+    for (auto &e : errors)
+      if (e)
+        std::rethrow_exception(e);
+  }
+
+private:
+  const uint8_t *data_;
+  Header header_;
+  std::vector<uint64_t> offsets_; // frame offsets, from the index
+  size_t last_len_ = 0;
+};
+
+} // namespace container
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+// Whole-buffer read/write loops on raw descriptors (short transfers and
+// EINTR retried, errors thrown), shared by the streaming, file and
+// container paths of the CLI tools.
+
+namespace stream_io {
+
+/// @brief Reads until len bytes are in or EOF
+/// @return Bytes read (less than len only at EOF)
+inline size_t read_full(int fd, uint8_t *buf, size_t len) {
+  size_t got = 0;
+  while (got < len) {
+    ssize_t n = ::read(fd, buf + got, len - got);
+    if (n == 0)
+      break;
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      throw std::runtime_error(std::string("read failed: ") +
+                               strerror(errno));
+    }
+    got += static_cast<size_t>(n);
+  }
+  return got;
+}
+
+/// @brief Writes all len bytes (retries short writes and EINTR)
+inline void write_all(int fd, const uint8_t *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = ::write(fd, buf, len);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      throw std::runtime_error(std::string("write failed: ") +
+                               strerror(errno));
+    }
+    buf += n;
+    len -= static_cast<size_t>(n);
+  }
+}
+
+/// @brief pread of exactly len bytes at off
+/// @throws std::runtime_error on errors or a file shorter than off + len
+inline void pread_full(int fd, uint8_t *buf, size_t len, uint64_t off) {
+  while (len > 0) {
+    ssize_t n = ::pread(fd, buf, len, static_cast<off_t>(off));
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      throw std::runtime_error(std::string("read failed: ") +
+                               (n < 0 ? strerror(errno) : "file changed size"));
+    buf += n;
+    off += static_cast<uint64_t>(n);
+    len -= static_cast<size_t>(n);
+  }
+}
+
+/// @brief pwrite of all len bytes at off
+inline void pwrite_all(int fd, const uint8_t *buf, size_t len, uint64_t off) {
+  while (len > 0) {
+    ssize_t n = ::pwrite(fd, buf, len, static_cast<off_t>(off));
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      throw std::runtime_error(std::string("write failed: ") +
+                               (n < 0 ? strerror(errno) : "no progress"));
+    buf += n;
+    off += static_cast<uint64_t>(n);
+    len -= static_cast<size_t>(n);
+  }
+}
+
+} // namespace stream_io
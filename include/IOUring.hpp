@@ -0,0 +1,283 @@
+#pragma once
+
+#include "CTS.hpp"
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// io_uring file engine for --io uring: DEPTH chunk buffers cycle through
+// read -> cipher -> write, with every read and write in flight at its own
+// file offset, so the cipher runs on whichever buffer completes while the
+// device works on the others. The ring is driven with the raw syscalls
+// (no liburing); registered buffers are used when the kernel accepts them.
+// The file size is known up front, so chunking is planned like
+// stream_io::crypt_stream_parallel: every chunk is CHUNK bytes except the
+// last, which absorbs a tail of under 16 bytes and is the only one that
+// needs ciphertext stealing. Buffers are page aligned and every request
+// starts at a multiple of CHUNK, so the same engine serves O_DIRECT
+// descriptors (--direct) when the length is aligned too.
+
+namespace uring {
+
+constexpr size_t CHUNK = size_t(1) << 20; // bytes per read / write
+constexpr unsigned DEPTH = 8;             // chunk buffers in flight
+
+/// @brief Minimal io_uring submission / completion ring
+class Ring {
+public:
+  Ring() = default;
+  Ring(const Ring &) = delete;
+  Ring &operator=(const Ring &) = delete;
+  ~Ring() {
+    if (sqes_)
+      munmap(sqes_, sqes_size_);
+    if (cq_ring_ && cq_ring_ != sq_ring_)
+      munmap(cq_ring_, cq_ring_size_);
+    if (sq_ring_)
+      munmap(sq_ring_, sq_ring_size_);
+    if (fd_ >= 0)
+      close(fd_);
+  }
+
+  /// @return false when the kernel has no io_uring or it is disabled
+  bool init(unsigned entries) {
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+    if (fd_ < 0)
+      return false;
+
+    sq_ring_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    const bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single)
+      sq_ring_size_ = cq_ring_size_ =
+          sq_ring_size_ > cq_ring_size_ ? sq_ring_size_ : cq_ring_size_;
+    sq_ring_ = map(sq_ring_size_, IORING_OFF_SQ_RING);
+    cq_ring_ = single ? sq_ring_ : map(cq_ring_size_, IORING_OFF_CQ_RING);
+    sqes_size_ = p.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe *>(map(sqes_size_, IORING_OFF_SQES));
+    if (!sq_ring_ || !cq_ring_ || !sqes_)
+      return false;
+
+    auto *sq = static_cast<uint8_t *>(sq_ring_);
+    auto *cq = static_cast<uint8_t *>(cq_ring_);
+    sq_tail_ = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+    cq_head_ = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+    return true;
+  }
+
+  /// @brief Pins the buffers once for READ_FIXED / WRITE_FIXED; on failure
+  /// (e.g. RLIMIT_MEMLOCK) the plain opcodes are used
+  void register_buffers(const iovec *iov, unsigned n) {
+    fixed_ = syscall(__NR_io_uring_register, fd_, IORING_REGISTER_BUFFERS,
+                     iov, n) == 0;
+  }
+
+  /// @brief Queues a read or write of buffer buf_index; submitted by the
+  /// next wait(). The caller keeps at most one request per buffer in flight
+  void queue(bool write, int fd, uint8_t *buf, size_t len, uint64_t offset,
+             unsigned buf_index) {
+    const unsigned tail = *sq_tail_;
+    const unsigned idx = tail & sq_mask_;
+    io_uring_sqe &sqe = sqes_[idx];
+    memset(&sqe, 0, sizeof(sqe));
+    if (fixed_) {
+      sqe.opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+      sqe.buf_index = static_cast<uint16_t>(buf_index);
+    } else {
+      sqe.opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+    }
+    sqe.fd = fd;
+    sqe.addr = reinterpret_cast<uint64_t>(buf);
+    sqe.len = static_cast<uint32_t>(len);
+    sqe.off = offset;
+    sqe.user_data = buf_index;
+    sq_array_[idx] = idx;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    ++queued_;
+  }
+
+  /// @brief Submits the queued requests and waits for one completion
+  void wait() {
+    for (;;) {
+      const long n = syscall(__NR_io_uring_enter, fd_, queued_, 1,
+                             IORING_ENTER_GETEVENTS, nullptr, 0);
+      if (n >= 0) {
+        queued_ -= static_cast<unsigned>(n);
+        return;
+      }
+      if (errno != EINTR)
+        throw std::runtime_error(std::string("io_uring_enter failed: ") +
+                                 strerror(errno));
+    }
+  }
+
+  /// @brief Calls f(buffer index, result) for every completion
+  template <typename F> void reap(F f) {
+    unsigned head = *cq_head_;
+    const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+      const io_uring_cqe &cqe = cqes_[head & cq_mask_];
+      const uint64_t user_data = cqe.user_data;
+      const int res = cqe.res;
+      __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+      f(static_cast<unsigned>(user_data), res);
+    }
+  }
+
+private:
+  void *map(size_t size, uint64_t offset) {
+    void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd_, static_cast<off_t>(offset));
+    return p == MAP_FAILED ? nullptr : p;
+  }
+
+  int fd_ = -1;
+  void *sq_ring_ = nullptr, *cq_ring_ = nullptr;
+  size_t sq_ring_size_ = 0, cq_ring_size_ = 0, sqes_size_ = 0;
+  io_uring_sqe *sqes_ = nullptr;
+  unsigned *sq_tail_ = nullptr, *sq_array_ = nullptr;
+  unsigned *cq_head_ = nullptr, *cq_tail_ = nullptr;
+  unsigned sq_mask_ = 0, cq_mask_ = 0;
+  io_uring_cqe *cqes_ = nullptr;
+  unsigned queued_ = 0;
+  bool fixed_ = false;
+};
+
+/// @brief Page-aligned anonymous buffer pool (also valid for O_DIRECT)
+struct Buffers {
+  uint8_t *base = nullptr;
+  size_t size = 0;
+
+  explicit Buffers(size_t bytes) : size(bytes) {
+    void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+      throw std::runtime_error(std::string("Cannot allocate buffers: ") +
+                               strerror(errno));
+    base = static_cast<uint8_t *>(p);
+  }
+  Buffers(const Buffers &) = delete;
+  Buffers &operator=(const Buffers &) = delete;
+  ~Buffers() { munmap(base, size); }
+};
+
+/// @brief Encrypts (or decrypts) size bytes of in_fd into out_fd, both at
+/// offset 0, through io_uring. out_fd may be in_fd (in place): each chunk
+/// is read before it is written, and only over its own range.
+/// @param tweak Tweak of block 0 (block i uses tweak + i), nullptr for none
+/// @param whole The range is the whole message, ending with the stealing
+/// tail; false for a leading part of it (size a multiple of 16), which is
+/// all plain blocks
+/// @return false (nothing done) when io_uring is unavailable
+/// @throws std::runtime_error on I/O errors
+template <bool Decrypt, typename Cipher>
+bool crypt_file(const Cipher &aes, int in_fd, int out_fd, size_t size,
+                const uint8_t *tweak, bool whole = true) {
+  if (whole)
+    cts::check_length(size);
+  else if (size % 16 != 0)
+    throw std::invalid_argument("Partial range must be whole blocks");
+  // Buffers outlive the ring, so nothing in flight points at freed memory
+  constexpr size_t STRIDE = CHUNK + 4096; // a chunk plus a short tail
+  Buffers pool(DEPTH * STRIDE);
+  Ring ring;
+  if (!ring.init(2 * DEPTH))
+    return false;
+  iovec iov[DEPTH];
+  for (unsigned b = 0; b < DEPTH; ++b)
+    iov[b] = {pool.base + b * STRIDE, STRIDE};
+  ring.register_buffers(iov, DEPTH);
+
+  // Chunk plan: a last piece of 1..15 bytes joins the chunk before it
+  uint64_t nchunks = size / CHUNK + (size % CHUNK != 0);
+  if (whole && nchunks > 1 && size % CHUNK != 0 && size % CHUNK < 16)
+    --nchunks;
+  auto chunk_len = [&](uint64_t k) {
+    return k + 1 == nchunks ? size - k * CHUNK : CHUNK;
+  };
+
+  struct Slot {
+    uint64_t chunk = 0;
+    size_t done = 0; // bytes of the current read / write completed
+    bool writing = false;
+  } slots[DEPTH];
+  uint64_t next_chunk = 0, written = 0;
+
+  auto issue = [&](unsigned b) {
+    Slot &s = slots[b];
+    ring.queue(s.writing, s.writing ? out_fd : in_fd,
+               pool.base + b * STRIDE + s.done, chunk_len(s.chunk) - s.done,
+               s.chunk * CHUNK + s.done, b);
+  };
+  auto start_read = [&](unsigned b) {
+    slots[b] = {next_chunk++, 0, false};
+    issue(b);
+  };
+
+  for (unsigned b = 0; b < DEPTH && next_chunk < nchunks; ++b)
+    start_read(b);
+
+  uint8_t chunk_tweak[16];
+  while (written < nchunks) {
+    ring.wait();
+    ring.reap([&](unsigned b, int res) {
+      Slot &s = slots[b];
+      const char *op = s.writing ? "write" : "read";
+      if (res < 0)
+        throw std::runtime_error(std::string(op) +
+                                 " failed: " + strerror(-res));
+      if (res == 0)
+        throw std::runtime_error(std::string(op) +
+                                 " failed: file changed size");
+      s.done += static_cast<size_t>(res);
+      const size_t len = chunk_len(s.chunk);
+      if (s.done < len) {
+        issue(b); // short read or write: queue the rest
+        return;
+      }
+
+      if (s.writing) {
+        ++written;
+        if (next_chunk < nchunks)
+          start_read(b);
+        return;
+      }
+
+      // Read complete: cipher in place, then write it back at its offset
+      if (tweak)
+        cts::tweak_at(tweak, s.chunk * (CHUNK / 16), chunk_tweak);
+      const uint8_t *tw = tweak ? chunk_tweak : nullptr;
+      uint8_t *buf = pool.base + b * STRIDE;
+      const bool last = whole && s.chunk + 1 == nchunks;
+      if (!last && Decrypt)
+        aes.decrypt_blocks(buf, buf, len / 16, tw);
+      else if (!last)
+        aes.encrypt_blocks(buf, buf, len / 16, tw);
+      else if (Decrypt)
+        aes.decrypt(buf, buf, len, tw);
+      else
+        aes.encrypt(buf, buf, len, tw);
+      s.writing = true;
+      s.done = 0;
+      issue(b);
+    });
+  }
+  return true;
+}
+
+} // namespace uring
@@ -0,0 +1,293 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Minimal JSON for the benchmark reports (speed --json / --compare): a
+// value tree, a parser that throws std::runtime_error with the offset of
+// the first error, and string quoting for writers. Numbers are doubles;
+// \u escapes are decoded to UTF-8 (surrogate pairs included).
+
+namespace json {
+
+class Value {
+public:
+  enum Type { NUL, BOOL, NUMBER, STRING, ARRAY, OBJECT };
+
+  Value() = default;
+
+  Type type() const { return type_; }
+  bool is_null() const { return type_ == NUL; }
+  bool is_number() const { return type_ == NUMBER; }
+  bool is_string() const { return type_ == STRING; }
+  bool is_array() const { return type_ == ARRAY; }
+  bool is_object() const { return type_ == OBJECT; }
+
+  bool as_bool() const { return expect(BOOL).bool_; }
+  double as_number() const { return expect(NUMBER).number_; }
+  const std::string &as_string() const { return expect(STRING).string_; }
+
+  /// @return Array length, 0 for anything else
+  size_t size() const { return type_ == ARRAY ? items_.size() : 0; }
+  const Value &operator[](size_t i) const {
+    if (type_ != ARRAY || i >= items_.size())
+      throw std::runtime_error("JSON: array index out of range");
+    return items_[i];
+  }
+
+  bool has(const std::string &key) const {
+    return type_ == OBJECT && members_.count(key) != 0;
+  }
+  /// @return The member, or a null value if absent (so lookups chain)
+  const Value &operator[](const std::string &key) const {
+    static const Value null;
+    if (type_ != OBJECT)
+      return null;
+    auto it = members_.find(key);
+    return it == members_.end() ? null : it->second;
+  }
+
+  /// @brief Parses a complete JSON document
+  static Value parse(const std::string &text) {
+    size_t pos = 0;
+    Value v = parse_value(text, pos, 0);
+    skip_space(text, pos);
+    if (pos != text.size())
+      fail(pos, "trailing data");
+    return v;
+  }
+
+private:
+  static constexpr int MAX_DEPTH = 64;
+
+  const Value &expect(Type t) const {
+    if (type_ != t)
+      throw std::runtime_error("JSON: value has the wrong type");
+    return *this;
+  }
+
+  [[noreturn]] static void fail(size_t pos, const char *what) {
+    throw std::runtime_error("JSON: " + std::string(what) + " at offset " +
+                             std::to_string(pos));
+  }
+
+  static void skip_space(const std::string &s, size_t &pos) {
+    while (pos < s.size() && (s[pos] == ' ' || s[pos] == '\t' ||
+                              s[pos] == '\n' || s[pos] == '\r'))
+      ++pos;
+  }
+
+  static void literal(const std::string &s, size_t &pos, const char *word) {
+    for (const char *c = word; *c; ++c, ++pos)
+      if (pos >= s.size() || s[pos] != *c)
+        fail(pos, "invalid literal");
+  }
+
+  static Value parse_value(const std::string &s, size_t &pos, int depth) {
+    if (depth > MAX_DEPTH)
+      fail(pos, "nesting too deep");
+    skip_space(s, pos);
+    if (pos >= s.size())
+      fail(pos, "unexpected end");
+    Value v;
+    switch (s[pos]) {
+    case 'n':
+      literal(s, pos, "null");
+      break;
+    case 't':
+      literal(s, pos, "true");
+      v.type_ = BOOL;
+      v.bool_ = true;
+      break;
+    case 'f':
+      literal(s, pos, "false");
+      v.type_ = BOOL;
+      break;
+    case '"':
+      v.type_ = STRING;
+      v.string_ = parse_string(s, pos);
+      break;
+    case '[':
+      v.type_ = ARRAY;
+      ++pos;
+      skip_space(s, pos);
+      if (pos < s.size() && s[pos] == ']') {
+        ++pos;
+        break;
+      }
+      for (;;) {
+        v.items_.push_back(parse_value(s, pos, depth + 1));
+        skip_space(s, pos);
+        if (pos < s.size() && s[pos] == ',') {
+          ++pos;
+        } else if (pos < s.size() && s[pos] == ']') {
+          ++pos;
+          break;
+        } else {
+          fail(pos, "expected ',' or ']'");
+        }
+      }
+      break;
+    case '{':
+      v.type_ = OBJECT;
+      ++pos;
+      skip_space(s, pos);
+      if (pos < s.size() && s[pos] == '}') {
+        ++pos;
+        break;
+      }
+      for (;;) {
+        skip_space(s, pos);
+        if (pos >= s.size() || s[pos] != '"')
+          fail(pos, "expected a member name");
+        std::string key = parse_string(s, pos);
+        skip_space(s, pos);
+        if (pos >= s.size() || s[pos] != ':')
+          fail(pos, "expected ':'");
+        ++pos;
+        v.members_[key] = parse_value(s, pos, depth + 1);
+        skip_space(s, pos);
+        if (pos < s.size() && s[pos] == ',') {
+          ++pos;
+        } else if (pos < s.size() && s[pos] == '}') {
+          ++pos;
+          break;
+        } else {
+          fail(pos, "expected ',' or '}'");
+        }
+      }
+      break;
+    default: {
+      const char *start = s.c_str() + pos;
+      char *end = nullptr;
+      if (s[pos] != '-' && (s[pos] < '0' || s[pos] > '9'))
+        fail(pos, "unexpected character");
+      v.type_ = NUMBER;
+      v.number_ = strtod(start, &end);
+      if (end == start)
+        fail(pos, "invalid number");
+      pos += static_cast<size_t>(end - start);
+    }
+    }
+    return v;
+  }
+
+  static unsigned hex4(const std::string &s, size_t &pos) {
+    if (pos + 4 > s.size())
+      fail(pos, "truncated \\u escape");
+    unsigned cp = 0;
+    for (int i = 0; i < 4; ++i, ++pos) {
+      const char c = s[pos];
+      cp <<= 4;
+      if (c >= '0' && c <= '9')
+        cp |= unsigned(c - '0');
+      else if (c >= 'a' && c <= 'f')
+        cp |= unsigned(c - 'a' + 10);
+      else if (c >= 'A' && c <= 'F')
+        cp |= unsigned(c - 'A' + 10);
+      else
+        fail(pos, "invalid \\u escape");
+    }
+    return cp;
+  }
+
+  static void put_utf8(std::string &out, unsigned cp) {
+    if (cp < 0x80) {
+      out += char(cp);
+    } else if (cp < 0x800) {
+      out += char(0xC0 | (cp >> 6));
+      out += char(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+      out += char(0xE0 | (cp >> 12));
+      out += char(0x80 | ((cp >> 6) & 0x3F));
+      out += char(0x80 | (cp & 0x3F));
+    } else {
+      out += char(0xF0 | (cp >> 18));
+      out += char(0x80 | ((cp >> 12) & 0x3F));
+      out += char(0x80 | ((cp >> 6) & 0x3F));
+      out += char(0x80 | (cp & 0x3F));
+    }
+  }
+
+  static std::string parse_string(const std::string &s, size_t &pos) {
+    std::string out;
+    ++pos; // opening quote
+    for (;;) {
+      if (pos >= s.size())
+        fail(pos, "unterminated string");
+      const char c = s[pos++];
+      if (c == '"')
+        return out;
+      if (static_cast<unsigned char>(c) < 0x20)
+        fail(pos - 1, "control character in string");
+      if (c != '\\') {
+        out += c;
+        continue;
+      }
+      if (pos >= s.size())
+        fail(pos, "unterminated string");
+      switch (s[pos++]) {
+      case '"': out += '"'; break;
+      case '\\': out += '\\'; break;
+      case '/': out += '/'; break;
+      case 'b': out += '\b'; break;
+      case 'f': out += '\f'; break;
+      case 'n': out += '\n'; break;
+      case 'r': out += '\r'; break;
+      case 't': out += '\t'; break;
+      case 'u': {
+        unsigned cp = hex4(s, pos);
+        if (cp >= 0xD800 && cp < 0xDC00 && pos + 6 <= s.size() &&
+            s[pos] == '\\' && s[pos + 1] == 'u') {
+          size_t next = pos + 2;
+          const unsigned low = hex4(s, next);
+          if (low >= 0xDC00 && low < 0xE000) {
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+            pos = next;
+          }
+        }
+        put_utf8(out, cp);
+        break;
+      }
+      default:
+        fail(pos - 1, "invalid escape");
+      }
+    }
+  }
+
+  Type type_ = NUL;
+  bool bool_ = false;
+  double number_ = 0;
+  std::string string_;
+  std::vector<Value> items_;
+  std::map<std::string, Value> members_;
+};
+
+/// @brief s as a JSON string literal, quotes included
+inline std::string quote(const std::string &s) {
+  std::string out = "\"";
+  for (const char c : s) {
+    switch (c) {
+    case '"': out += "\\\""; break;
+    case '\\': out += "\\\\"; break;
+    case '\n': out += "\\n"; break;
+    case '\r': out += "\\r"; break;
+    case '\t': out += "\\t"; break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        char esc[8];
+        snprintf(esc, sizeof(esc), "\\u%04x", c);
+        out += esc;
+      } else {
+        out += c;
+      }
+    }
+  }
+  return out + "\"";
+}
+
+} // namespace json
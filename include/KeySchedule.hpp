@@ -0,0 +1,237 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+              "KeySchedule tweak arithmetic assumes a little-endian host");
+
+/// @brief Round count and tweak round of one key size as compile-time
+/// constants, for the fixed-size engines (AESEngine, AESNIEngine)
+template <int KeyBits> struct KeyTraits {
+  static_assert(KeyBits == 128 || KeyBits == 192 || KeyBits == 256,
+                "Key size must be 128, 192, or 256 bits");
+  static constexpr int ROUNDS = KeyBits / 32 + 6; // 10, 12, 14
+  // The tweak goes into the middle round: 5, 6, 7
+  static constexpr int TWEAK_ROUND = KeyBits / 64 + 3;
+};
+
+/// @brief Calls f(std::integral_constant<int, KeyBits>) for a runtime key
+/// size, so the runtime-sized classes pick a fixed-size engine once per call
+template <typename F> decltype(auto) dispatch_key_size(int key_size, F &&f) {
+  switch (key_size) {
+  case 128:
+    return f(std::integral_constant<int, 128>());
+  case 192:
+    return f(std::integral_constant<int, 192>());
+  case 256:
+    return f(std::integral_constant<int, 256>());
+  default:
+    throw std::invalid_argument(
+        "Invalid key size. Must be 128, 192, or 256 bits");
+  }
+}
+
+/// @brief Expanded T-AES key material shared by the AES and AESNI engines.
+/// Built once per (key, tweak) and never modified afterwards, so a single
+/// instance can be shared read-only between any number of engine objects and
+/// threads. Everything a block operation needs is precomputed here:
+/// - enc: forward round keys (rounds 0..n_rounds)
+/// - dec: equivalent-inverse-cipher keys, InvMixColumns(enc[r]) for the
+///   middle rounds and enc[0]/enc[n_rounds] unchanged
+/// - tweaked_enc / tweaked_dec: the tweak-round key with the base tweak added
+///   (mod 2^128), forward and inverse form
+/// Rows are 16-byte aligned so the AES-NI path loads them directly, and the
+/// whole object is cache-line aligned (9 lines for AES-256).
+struct alignas(64) KeySchedule {
+  static constexpr int MAX_ROUNDS = 14;
+
+  alignas(16) uint8_t enc[MAX_ROUNDS + 1][16];
+  alignas(16) uint8_t dec[MAX_ROUNDS + 1][16];
+  alignas(16) uint8_t tweaked_enc[16];
+  alignas(16) uint8_t tweaked_dec[16];
+  alignas(16) uint8_t tweak[16]; // base tweak (block 0)
+  int key_size = 0;
+  int n_rounds = 0;
+  int tweak_round = 0;
+  bool has_tweak = false;
+
+  /// @brief KeyTraits<key_size>::ROUNDS for a runtime key size
+  static int rounds_for(int key_size) {
+    return dispatch_key_size(key_size, [](auto bits) {
+      return KeyTraits<decltype(bits)::value>::ROUNDS;
+    });
+  }
+
+  /// @brief KeyTraits<key_size>::TWEAK_ROUND for a runtime key size
+  static int tweak_round_for(int key_size) {
+    return dispatch_key_size(key_size, [](auto bits) {
+      return KeyTraits<decltype(bits)::value>::TWEAK_ROUND;
+    });
+  }
+
+  /// @brief Round count argument of the engine constructors, checked
+  /// against the key size so n_rounds always matches the schedule
+  /// @return rounds
+  /// @throws std::invalid_argument if rounds is not rounds_for(key_size)
+  static int checked_rounds(int key_size, int rounds) {
+    if (rounds != rounds_for(key_size)) {
+      throw std::invalid_argument("AES-" + std::to_string(key_size) +
+                                  " has " +
+                                  std::to_string(rounds_for(key_size)) +
+                                  " rounds, not " + std::to_string(rounds));
+    }
+    return rounds;
+  }
+
+  /// @brief Arithmetic addition (mod 2^128) of tweak to round key
+  /// @note Little-endian: byte 0 is the least significant byte, so on x86
+  /// this is two 64-bit adds with one carry instead of a 16-step byte loop
+  static void add_tweak(const uint8_t *round_key, const uint8_t *tweak,
+                        uint8_t *out) {
+    uint64_t rk[2], tw[2];
+    memcpy(rk, round_key, 16);
+    memcpy(tw, tweak, 16);
+    uint64_t sum[2];
+    sum[0] = rk[0] + tw[0];
+    sum[1] = rk[1] + tw[1] + (sum[0] < rk[0]);
+    memcpy(out, sum, 16);
+  }
+
+  /// @brief Reads a 16-byte tweak as the 128-bit big-endian block counter
+  /// (hi:lo) that utils::increment_tweak advances
+  static void load_counter(const uint8_t *tweak, uint64_t &hi, uint64_t &lo) {
+    uint64_t be_hi, be_lo;
+    memcpy(&be_hi, tweak, 8);
+    memcpy(&be_lo, tweak + 8, 8);
+    hi = __builtin_bswap64(be_hi);
+    lo = __builtin_bswap64(be_lo);
+  }
+
+  /// @brief add_tweak for the tweak whose big-endian counter value is hi:lo
+  /// @note The counter bytes read little-endian are bswap64(hi) (low half)
+  /// and bswap64(lo) (high half), so no byte array is materialized
+  static void add_tweak_counter(const uint8_t *round_key, uint64_t hi,
+                                uint64_t lo, uint8_t *out) {
+    uint64_t rk[2];
+    memcpy(rk, round_key, 16);
+    uint64_t sum[2];
+    sum[0] = rk[0] + __builtin_bswap64(hi);
+    sum[1] = rk[1] + __builtin_bswap64(lo) + (sum[0] < rk[0]);
+    memcpy(out, sum, 16);
+  }
+
+  /// @brief InvMixColumns of one 16-byte round key (column-major, as stored);
+  /// branch-free GF(2^8) arithmetic on whole columns, no table lookups.
+  /// in may be out
+  static void inv_mix_columns(const uint8_t *in, uint8_t *out) {
+    // xtime of the four bytes of a column word at once
+    auto xt = [](uint32_t w) {
+      return ((w & 0x7f7f7f7fu) << 1) ^ (((w >> 7) & 0x01010101u) * 0x1bu);
+    };
+    auto ror = [](uint32_t w, int n) { return (w >> n) | (w << (32 - n)); };
+    uint32_t col[4]; // row 0 in the low byte
+    memcpy(col, in, 16);
+    for (uint32_t &w : col) {
+      // InvMixColumns is MixColumns after a_i ^= 4 * (a_i ^ a_(i+2))
+      w ^= xt(xt(w ^ ror(w, 16)));
+      const uint32_t next = ror(w, 8); // a_(i+1) in byte i
+      w = xt(w ^ next) ^ next ^ ror(w, 16) ^ ror(w, 24);
+    }
+    memcpy(out, col, 16);
+  }
+
+  /// @brief Builds the immutable schedule from already expanded forward keys
+  /// @param key_size 128, 192 or 256
+  /// @param forward n_rounds + 1 forward round keys
+  /// @param tweak 16-byte base tweak, or empty for plain AES
+  static std::shared_ptr<const KeySchedule>
+  from_round_keys(int key_size, const uint8_t (*forward)[16],
+                  const std::vector<uint8_t> &tweak) {
+    if (!tweak.empty() && tweak.size() != 16) {
+      throw std::invalid_argument("Tweak must be exactly 16 bytes");
+    }
+    auto ks = std::make_shared<KeySchedule>();
+    ks->key_size = key_size;
+    ks->n_rounds = rounds_for(key_size);
+    ks->tweak_round = tweak_round_for(key_size);
+    ks->has_tweak = !tweak.empty();
+
+    memcpy(ks->enc, forward, 16 * (ks->n_rounds + 1));
+    memcpy(ks->dec[0], ks->enc[0], 16);
+    memcpy(ks->dec[ks->n_rounds], ks->enc[ks->n_rounds], 16);
+    for (int r = 1; r < ks->n_rounds; ++r) {
+      inv_mix_columns(ks->enc[r], ks->dec[r]);
+    }
+
+    memset(ks->tweak, 0, 16);
+    memcpy(ks->tweaked_enc, ks->enc[ks->tweak_round], 16);
+    memcpy(ks->tweaked_dec, ks->dec[ks->tweak_round], 16);
+    if (ks->has_tweak) {
+      memcpy(ks->tweak, tweak.data(), 16);
+      add_tweak(ks->enc[ks->tweak_round], ks->tweak, ks->tweaked_enc);
+      inv_mix_columns(ks->tweaked_enc, ks->tweaked_dec);
+    }
+    return ks;
+  }
+
+  /// @brief FIPS-197 key expansion into a schedule, with SubWord supplied
+  /// by the engine. With a constant-time S-box (bitsliced, vperm) nothing
+  /// is looked up at an address that depends on the key
+  /// @param key key_size / 8 bytes
+  /// @param tweak 16-byte base tweak, or empty for plain AES
+  /// @param sub_word S-box applied to each byte of a little-endian column
+  /// word (row 0 in the low byte)
+  template <typename SubWord>
+  static std::shared_ptr<const KeySchedule>
+  expand(int key_size, const std::vector<uint8_t> &key,
+         const std::vector<uint8_t> &tweak, SubWord sub_word) {
+    const int rounds = rounds_for(key_size);
+    const int nk = key_size / 32; // key words: 4, 6 or 8
+    if (key.size() != static_cast<size_t>(4 * nk)) {
+      throw std::invalid_argument("AES-" + std::to_string(key_size) +
+                                  " needs a " + std::to_string(4 * nk) +
+                                  "-byte key");
+    }
+    uint32_t w[4 * (MAX_ROUNDS + 1)];
+    memcpy(w, key.data(), key.size());
+    uint8_t rcon = 1;
+    for (int i = nk; i < 4 * (rounds + 1); ++i) {
+      uint32_t t = w[i - 1];
+      if (i % nk == 0) {
+        // RotWord (byte r takes byte r + 1), SubWord, Rcon into row 0
+        t = sub_word((t >> 8) | (t << 24)) ^ rcon;
+        rcon = static_cast<uint8_t>((rcon << 1) ^ ((rcon & 0x80) ? 0x1b : 0));
+      } else if (nk > 6 && i % nk == 4) {
+        t = sub_word(t);
+      }
+      w[i] = w[i - nk] ^ t;
+    }
+    uint8_t forward[MAX_ROUNDS + 1][16];
+    memcpy(forward, w, 16 * (rounds + 1));
+    return from_round_keys(key_size, forward, tweak);
+  }
+
+  /// @brief Tweak argument of the vector APIs as a pointer: empty means
+  /// untweaked (nullptr), anything but 16 bytes is rejected
+  static const uint8_t *checked_tweak(const std::vector<uint8_t> &tweak) {
+    if (!tweak.empty() && tweak.size() != 16) {
+      throw std::invalid_argument("Tweak must be exactly 16 bytes");
+    }
+    return tweak.empty() ? nullptr : tweak.data();
+  }
+
+  /// @brief Base tweak for the pointer APIs (nullptr when untweaked)
+  const uint8_t *tweak_ptr() const { return has_tweak ? tweak : nullptr; }
+
+  /// @brief Base tweak as a vector (empty when untweaked)
+  std::vector<uint8_t> tweak_vector() const {
+    return has_tweak ? std::vector<uint8_t>(tweak, tweak + 16)
+                     : std::vector<uint8_t>();
+  }
+};
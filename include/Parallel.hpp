@@ -0,0 +1,134 @@
+#pragma once
+
+#include "CTS.hpp"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Multi-core encryption of one message that is entirely in memory (an
+// mmap'd file). Block i only depends on the key and tweak + i, so the
+// message is cut into contiguous block ranges and every worker starts its
+// own copy of the engine at tweak + first block. Ciphertext stealing only
+// touches the last two blocks: the last range is run through the message
+// API and takes the tail, so the output is byte-identical to one call to
+// aes.encrypt / aes.decrypt over the whole message.
+//
+// EventCount is the blocking primitive of the streaming pipeline
+// (stream_io::crypt_stream_parallel), whose ring hands chunks between
+// threads with atomic slot states only.
+
+namespace parallel {
+
+// Below this many blocks per worker (64 KiB) a thread costs more than it
+// saves
+constexpr size_t MIN_JOB_BLOCKS = 4096;
+
+/// @brief Lets threads sleep until a lock-free condition may have changed.
+/// Waiters snapshot the epoch, test their condition and sleep on the futex
+/// only if nothing was published since; every publish bumps the epoch, so
+/// no wakeup is lost. The syscall is skipped when nobody sleeps.
+class EventCount {
+public:
+  /// @brief Returns once pred() holds (pred reads the shared atomics)
+  template <typename Pred> void await(Pred pred) {
+    for (;;) {
+      const uint32_t epoch = epoch_.load(std::memory_order_seq_cst);
+      if (pred())
+        return;
+      waiters_.fetch_add(1, std::memory_order_seq_cst);
+      if (epoch_.load(std::memory_order_seq_cst) == epoch)
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(&epoch_),
+                FUTEX_WAIT_PRIVATE, epoch, nullptr, nullptr, 0);
+      waiters_.fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+
+  /// @brief Wakes every waiter; call after publishing a state change
+  void notify() {
+    epoch_.fetch_add(1, std::memory_order_seq_cst);
+    if (waiters_.load(std::memory_order_seq_cst) != 0)
+      syscall(SYS_futex, reinterpret_cast<uint32_t *>(&epoch_),
+              FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+  }
+
+private:
+  static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t) &&
+                    std::atomic<uint32_t>::is_always_lock_free,
+                "futex needs a plain 32-bit word");
+  std::atomic<uint32_t> epoch_{0};
+  std::atomic<uint32_t> waiters_{0};
+};
+
+/// @brief Number of workers for a message of nblocks full blocks
+inline unsigned worker_count(unsigned jobs, size_t nblocks) {
+  const size_t useful = std::max<size_t>(1, nblocks / MIN_JOB_BLOCKS);
+  return static_cast<unsigned>(std::min<size_t>(std::max(jobs, 1u), useful));
+}
+
+/// @brief Encrypts (or decrypts) len bytes with up to jobs threads
+/// @param tweak Tweak of block 0 (block i uses tweak + i), nullptr for none
+/// @note out may equal in (in-place); the calling thread runs the last range
+template <bool Decrypt, typename Cipher>
+void crypt(const Cipher &aes, const uint8_t *in, uint8_t *out, size_t len,
+           const uint8_t *tweak, unsigned jobs) {
+  cts::check_length(len);
+  const size_t nblocks = len / 16;
+  const unsigned workers = worker_count(jobs, nblocks);
+  const size_t per_worker = nblocks / workers;
+
+  // Range w starts at block w * per_worker; the last one runs to the end
+  auto run_range = [&](unsigned w) {
+    const Cipher local(aes); // own context, shared key schedule
+    const size_t first = w * per_worker;
+    uint8_t range_tweak[16];
+    if (tweak)
+      cts::tweak_at(tweak, first, range_tweak);
+    const uint8_t *tw = tweak ? range_tweak : nullptr;
+    const uint8_t *src = in + 16 * first;
+    uint8_t *dst = out + 16 * first;
+
+    if (w + 1 < workers) {
+      if (Decrypt)
+        local.decrypt_blocks(src, dst, per_worker, tw);
+      else
+        local.encrypt_blocks(src, dst, per_worker, tw);
+    } else if (Decrypt) {
+      local.decrypt(src, dst, len - 16 * first, tw);
+    } else {
+      local.encrypt(src, dst, len - 16 * first, tw);
+    }
+  };
+
+  std::vector<std::exception_ptr> errors(workers);
+  std::vector<std::thread> threads;
+  threads.reserve(workers - 1);
+  for (unsigned w = 0; w + 1 < workers; ++w) {
+    threads.emplace_back([&, w] {
+      try {
+        run_range(w);
+      } catch (...) {
+        errors[w] = std::current_exception();
+      }
+    });
+  }
+  try {
+    run_range(workers - 1);
+  } catch (...) {
+    errors[workers - 1] = std::current_exception();
+  }
+  for (auto &t : threads)
+    t.join();
+  for (auto &e : errors)
+    if (e)
+      std::rethrow_exception(e);
+}
+
+} // namespace parallel
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Hardware performance counters around a measured region (speed --perf),
+// through perf_event_open on the calling thread. Only user-space events are
+// requested, which the default perf_event_paranoid (2) allows. Each event
+// is opened on its own rather than as a group, so a PMU that lacks one, a
+// VM without a virtual PMU (software events only) or a container whose
+// seccomp profile blocks the syscall costs just the events concerned;
+// nothing here throws. When the kernel multiplexes, counts are scaled by
+// time_enabled / time_running.
+
+namespace perf {
+
+enum Event {
+  INSTRUCTIONS,
+  CYCLES,
+  L1D_MISSES,  // L1 data cache read misses
+  LLC_MISSES,  // last-level cache misses
+  BRANCH_MISSES,
+  PAGE_FAULTS, // software event, available without a PMU
+  NUM_EVENTS
+};
+
+inline const char *event_name(Event e) {
+  static const char *const names[NUM_EVENTS] = {
+      "instructions", "cycles",        "l1d_misses",
+      "llc_misses",   "branch_misses", "page_faults"};
+  return names[e];
+}
+
+/// @brief Counts of one region; -1 for an event that could not be counted
+struct Reading {
+  double value[NUM_EVENTS];
+
+  Reading() {
+    for (double &v : value)
+      v = -1;
+  }
+  bool has(Event e) const { return value[e] >= 0; }
+  /// @brief Adds o's counts; an event missing from either stays missing
+  void add(const Reading &o) {
+    for (int e = 0; e < NUM_EVENTS; ++e)
+      value[e] = value[e] >= 0 && o.value[e] >= 0 ? value[e] + o.value[e] : -1;
+  }
+  bool any() const {
+    for (double v : value)
+      if (v >= 0)
+        return true;
+    return false;
+  }
+};
+
+/// @brief The events of one thread, opened once and reused for every
+/// start() / stop() pair
+class Counters {
+public:
+  Counters() {
+    for (int e = 0; e < NUM_EVENTS; ++e) {
+      fd_[e] = open_event(static_cast<Event>(e));
+      if (fd_[e] < 0 && error_.empty())
+        error_ = std::string(event_name(static_cast<Event>(e))) + ": " +
+                 strerror(errno);
+    }
+  }
+  Counters(const Counters &) = delete;
+  Counters &operator=(const Counters &) = delete;
+  ~Counters() {
+    for (int fd : fd_)
+      if (fd >= 0)
+        close(fd);
+  }
+
+  /// @return true if at least one event is counting
+  bool available() const {
+    for (int fd : fd_)
+      if (fd >= 0)
+        return true;
+    return false;
+  }
+
+  /// @return Why the first unavailable event failed to open, empty if none
+  const std::string &error() const { return error_; }
+
+  /// @brief Zeroes and starts every open event
+  void start() {
+    for (int fd : fd_)
+      if (fd >= 0)
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    for (int fd : fd_)
+      if (fd >= 0)
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+
+  /// @brief Stops the events and returns their counts since start()
+  Reading stop() {
+    for (int fd : fd_)
+      if (fd >= 0)
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    Reading r;
+    for (int e = 0; e < NUM_EVENTS; ++e) {
+      uint64_t data[3]; // value, time enabled, time running
+      if (fd_[e] < 0 || read(fd_[e], data, sizeof(data)) != sizeof(data) ||
+          data[2] == 0)
+        continue; // never scheduled onto the PMU
+      r.value[e] = double(data[0]) * double(data[1]) / double(data[2]);
+    }
+    return r;
+  }
+
+private:
+  static int open_event(Event e) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    switch (e) {
+    case INSTRUCTIONS:
+      attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+      break;
+    case CYCLES:
+      attr.config = PERF_COUNT_HW_CPU_CYCLES;
+      break;
+    case L1D_MISSES:
+      attr.type = PERF_TYPE_HW_CACHE;
+      attr.config = PERF_COUNT_HW_CACHE_L1D |
+                    (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+      break;
+    case LLC_MISSES:
+      attr.config = PERF_COUNT_HW_CACHE_MISSES;
+      break;
+    case BRANCH_MISSES:
+      attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+      break;
+    default:
+      attr.type = PERF_TYPE_SOFTWARE;
+      attr.config = PERF_COUNT_SW_PAGE_FAULTS;
+      break;
+    }
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1,
+                                    PERF_FLAG_FD_CLOEXEC));
+  }
+
+  int fd_[NUM_EVENTS];
+  std::string error_;
+};
+
+} // namespace perf
@@ -0,0 +1,205 @@
+#pragma once
+
+#include "CTS.hpp"
+#include "KeySchedule.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+// Storage-style (dm-crypt like) use of the engines: a device is a sequence
+// of data units (512 B or 4 KiB sectors) and a request is a scatter list of
+// buffers, each holding a run of consecutive units starting at some sector
+// number. Every unit is encrypted on its own, in place, with the counter
+// tweaks it would get if the whole device were one message: block j of
+// sector s uses tweak + s * (unit / 16) + j. A run of units therefore has
+// contiguous tweaks and goes to the multi-block kernel in a single call,
+// and an encrypted device image decrypts with the ordinary tools or
+// decrypt_range. Units are whole blocks, so no ciphertext stealing.
+
+namespace sectors {
+
+/// @brief One scatter-gather entry: len / unit_size consecutive data units
+/// starting at unit number sector, processed in place
+struct Span {
+  uint64_t sector; // number of the first unit in data
+  uint8_t *data;   // len bytes
+  size_t len;      // multiple of the unit size
+};
+
+/// @brief Throws std::invalid_argument unless unit_size is a power of two
+/// from 512 to 4096 (the sector sizes dm-crypt accepts)
+inline void check_unit(size_t unit_size) {
+  if (unit_size < 512 || unit_size > 4096 ||
+      (unit_size & (unit_size - 1)) != 0) {
+    throw std::invalid_argument("Data unit size must be 512, 1024, 2048 or "
+                                "4096 bytes");
+  }
+}
+
+/// @brief Encrypts (or decrypts) every span in place, one bulk call each
+/// @param tweak Base tweak (nullptr: zero, so unit tweaks are the plain
+/// block counters)
+/// @throws std::invalid_argument for a bad unit size or span length,
+/// std::out_of_range if a span's block counter would pass 2^64
+template <bool Decrypt, typename Cipher>
+void crypt(const Cipher &aes, const Span *spans, size_t count,
+           size_t unit_size, const uint8_t *tweak) {
+  check_unit(unit_size);
+  static const uint8_t zero[16] = {};
+  const uint8_t *base = tweak ? tweak : zero;
+  const uint64_t unit_blocks = unit_size / 16;
+
+  uint8_t span_tweak[16];
+  for (size_t i = 0; i < count; ++i) {
+    const Span &s = spans[i];
+    if (s.len % unit_size != 0) {
+      throw std::invalid_argument(
+          "Sector buffer length must be a multiple of the data unit size");
+    }
+    const uint64_t nblocks = s.len / 16;
+    if (s.sector > (UINT64_MAX - nblocks) / unit_blocks)
+      throw std::out_of_range("Sector number too large");
+    cts::tweak_at(base, s.sector * unit_blocks, span_tweak);
+    if (Decrypt)
+      aes.decrypt_blocks(s.data, s.data, nblocks, span_tweak);
+    else
+      aes.encrypt_blocks(s.data, s.data, nblocks, span_tweak);
+  }
+}
+
+} // namespace sectors
+
+// The bulk and message API every engine (AES, AESNI, AESBitslice, AESVperm)
+// offers, written once over what the engine itself provides: the kernel
+//   template <bool Decrypt>
+//   void process_blocks(in, out, nblocks, const uint8_t *tweak) const
+// and key_schedule() for the constructor tweak. An engine derives from
+// BulkCipher<itself> and befriends it, so every call resolves statically.
+
+template <typename Engine> class BulkCipher {
+public:
+  /// @brief Encrypts nblocks contiguous 16-byte blocks
+  /// @param in Input blocks (16 * nblocks bytes)
+  /// @param out Output blocks, may be the same buffer as in
+  /// @param nblocks Number of 16-byte blocks
+  /// @param tweak_start Tweak of the first block; block i uses tweak_start + i
+  /// (counter mode, big-endian). Empty means no tweak
+  void encrypt_blocks(const uint8_t *in, uint8_t *out, size_t nblocks,
+                      const std::vector<uint8_t> &tweak_start) const {
+    blocks<false>(in, out, nblocks, KeySchedule::checked_tweak(tweak_start));
+  }
+
+  /// @brief encrypt_blocks with the tweak as a pointer (nullptr for none)
+  void encrypt_blocks(const uint8_t *in, uint8_t *out, size_t nblocks,
+                      const uint8_t *tweak_start) const {
+    blocks<false>(in, out, nblocks, tweak_start);
+  }
+
+  /// @brief Encrypts nblocks starting at the constructor tweak
+  void encrypt_blocks(const uint8_t *in, uint8_t *out, size_t nblocks) const {
+    blocks<false>(in, out, nblocks, base_tweak());
+  }
+
+  /// @brief Decrypts nblocks contiguous 16-byte blocks
+  /// @param in Input blocks (16 * nblocks bytes)
+  /// @param out Output blocks, may be the same buffer as in
+  /// @param nblocks Number of 16-byte blocks
+  /// @param tweak_start Tweak of the first block; block i uses tweak_start + i
+  void decrypt_blocks(const uint8_t *in, uint8_t *out, size_t nblocks,
+                      const std::vector<uint8_t> &tweak_start) const {
+    blocks<true>(in, out, nblocks, KeySchedule::checked_tweak(tweak_start));
+  }
+
+  /// @brief decrypt_blocks with the tweak as a pointer (nullptr for none)
+  void decrypt_blocks(const uint8_t *in, uint8_t *out, size_t nblocks,
+                      const uint8_t *tweak_start) const {
+    blocks<true>(in, out, nblocks, tweak_start);
+  }
+
+  /// @brief Decrypts nblocks starting at the constructor tweak
+  void decrypt_blocks(const uint8_t *in, uint8_t *out, size_t nblocks) const {
+    blocks<true>(in, out, nblocks, base_tweak());
+  }
+
+  /// @brief Encrypts a whole message with ciphertext stealing, without
+  /// allocating
+  /// @param in len bytes (0, or at least 16)
+  /// @param out len bytes, may be the same buffer as in
+  /// @param tweak Tweak of block 0 (nullptr for none); the overload without
+  /// it uses the constructor tweak
+  void encrypt(const uint8_t *in, uint8_t *out, size_t len,
+               const uint8_t *tweak) const {
+    cts::encrypt(*this, in, out, len, tweak);
+  }
+
+  void encrypt(const uint8_t *in, uint8_t *out, size_t len) const {
+    cts::encrypt(*this, in, out, len, base_tweak());
+  }
+
+  /// @brief Decrypts a whole message produced by encrypt, without allocating
+  /// @param in len bytes (0, or at least 16)
+  /// @param out len bytes, may be the same buffer as in
+  /// @param tweak Tweak of block 0 (nullptr for none)
+  void decrypt(const uint8_t *in, uint8_t *out, size_t len,
+               const uint8_t *tweak) const {
+    cts::decrypt(*this, in, out, len, tweak);
+  }
+
+  void decrypt(const uint8_t *in, uint8_t *out, size_t len) const {
+    cts::decrypt(*this, in, out, len, base_tweak());
+  }
+
+  /// @brief Decrypts only bytes [offset, offset + count) of a message
+  /// produced by encrypt; see cts::decrypt_range
+  /// @param in The whole len byte message (only the blocks covering the
+  /// range are read)
+  /// @param out count bytes
+  void decrypt_range(const uint8_t *in, size_t len, size_t offset,
+                     size_t count, uint8_t *out, const uint8_t *tweak) const {
+    cts::decrypt_range(*this, in, len, offset, count, out, tweak);
+  }
+
+  void decrypt_range(const uint8_t *in, size_t len, size_t offset,
+                     size_t count, uint8_t *out) const {
+    cts::decrypt_range(*this, in, len, offset, count, out, base_tweak());
+  }
+
+  /// @brief Encrypts a scatter list of data units in place, one bulk call
+  /// per span; unit s block j uses tweak + s * (unit_size / 16) + j
+  /// @param unit_size 512 to 4096 bytes (power of two)
+  void encrypt_sectors(const sectors::Span *spans, size_t count,
+                       size_t unit_size, const uint8_t *tweak) const {
+    sectors::crypt<false>(*this, spans, count, unit_size, tweak);
+  }
+
+  void encrypt_sectors(const std::vector<sectors::Span> &spans,
+                       size_t unit_size) const {
+    sectors::crypt<false>(*this, spans.data(), spans.size(), unit_size,
+                          base_tweak());
+  }
+
+  void decrypt_sectors(const sectors::Span *spans, size_t count,
+                       size_t unit_size, const uint8_t *tweak) const {
+    sectors::crypt<true>(*this, spans, count, unit_size, tweak);
+  }
+
+  void decrypt_sectors(const std::vector<sectors::Span> &spans,
+                       size_t unit_size) const {
+    sectors::crypt<true>(*this, spans.data(), spans.size(), unit_size,
+                         base_tweak());
+  }
+
+private:
+  const Engine &engine() const { return static_cast<const Engine &>(*this); }
+
+  template <bool Decrypt>
+  void blocks(const uint8_t *in, uint8_t *out, size_t nblocks,
+              const uint8_t *tweak) const {
+    engine().template process_blocks<Decrypt>(in, out, nblocks, tweak);
+  }
+
+  const uint8_t *base_tweak() const {
+    return engine().key_schedule()->tweak_ptr();
+  }
+};
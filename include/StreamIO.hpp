@@ -0,0 +1,840 @@
+#pragma once
+
+#include "CTS.hpp"
+#include "Container.hpp"
+#include "FdIO.hpp"
+#include "IOUring.hpp"
+#include "Parallel.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <fcntl.h>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <vector>
+
+// Bounded-memory streaming for the CLI tools: the input is read in CHUNK
+// sized pieces and every full block is processed and written as soon as it
+// arrives, except the last 16..31 bytes. Those are held back until EOF,
+// because ciphertext stealing rewrites the last two blocks once the final
+// length is known. Memory use is one CHUNK + 31 byte buffer whatever the
+// input size, and the output is byte-identical to the whole-input path.
+//
+// With --in/--out or --in-place the tools skip the pipe entirely: files are
+// mmap'd and the cipher runs straight from one mapping into the other (or
+// over a single read-write mapping), see crypt_file / crypt_in_place. Being
+// seekable, mapped files can also be split across -j threads (Parallel.hpp),
+// or --io uring swaps the mappings for queued io_uring reads and writes
+// (--direct: O_DIRECT ones that bypass the page cache);
+// pipes get the same -j through an ordered pipeline, crypt_stream_parallel.
+// With one cipher thread (--overlap) that pipeline overlaps reading and
+// writing with the cipher on a single core. --vmsplice hands the output
+// pages to a stdout pipe instead of copying them, see crypt_stream_vmsplice.
+// --offset/--length decrypt only part of a seekable ciphertext, see
+// decrypt_range, and --container wraps the ciphertext in independently
+// decryptable chunks with an index (Container.hpp).
+
+namespace stream_io {
+
+constexpr size_t CHUNK = size_t(1) << 20; // 1 MiB per read
+constexpr size_t HOLD_BACK = 31;          // up to one full + one partial
+
+/// @brief Read-ahead hints for a regular input file; a no-op on pipes and
+/// terminals
+class ReadAhead {
+public:
+  static constexpr off_t WINDOW = 4 * CHUNK; // kept in flight ahead
+
+  explicit ReadAhead(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+      return;
+    offset_ = lseek(fd, 0, SEEK_CUR); // stdin may not start at 0
+    if (offset_ < 0)
+      return;
+    fd_ = fd;
+    posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(fd_, offset_, WINDOW, POSIX_FADV_WILLNEED);
+  }
+
+  /// @brief Call after each read of n bytes: queues the next window so the
+  /// disk works while the cipher does
+  void advance(size_t n) {
+    if (fd_ < 0)
+      return;
+    offset_ += static_cast<off_t>(n);
+    posix_fadvise(fd_, offset_, WINDOW, POSIX_FADV_WILLNEED);
+  }
+
+private:
+  int fd_ = -1;
+  off_t offset_ = 0;
+};
+
+/// @brief Encrypts (or decrypts) in_fd to out_fd until EOF
+/// @param aes Engine with the bulk and message interfaces
+/// @param tweak Tweak of block 0 (block i uses tweak + i), nullptr for none
+/// @throws std::invalid_argument for 1..15 bytes of input (nothing is
+/// written then), std::runtime_error on I/O errors
+template <bool Decrypt, typename Cipher>
+void crypt_stream(const Cipher &aes, int in_fd, int out_fd,
+                  const uint8_t *tweak) {
+  std::vector<uint8_t> buffer(CHUNK + HOLD_BACK);
+  uint8_t *buf = buffer.data();
+  size_t have = 0;     // bytes in buf (held-back tail first)
+  uint64_t blocks = 0; // blocks written so far
+  uint8_t block_tweak[16];
+  ReadAhead read_ahead(in_fd);
+
+  for (;;) {
+    const size_t want = buffer.size() - have;
+    const size_t got = read_full(in_fd, buf + have, want);
+    read_ahead.advance(got);
+    have += got;
+    if (tweak)
+      cts::tweak_at(tweak, blocks, block_tweak);
+    const uint8_t *tw = tweak ? block_tweak : nullptr;
+
+    if (got < want) {
+      // EOF: the remainder (held-back tail included) is one CTS message
+      if (Decrypt)
+        aes.decrypt(buf, buf, have, tw);
+      else
+        aes.encrypt(buf, buf, have, tw);
+      write_all(out_fd, buf, have);
+      return;
+    }
+
+    // Keep 16..31 bytes back; everything before is ordinary full blocks
+    const size_t n = (have - 16) / 16;
+    if (Decrypt)
+      aes.decrypt_blocks(buf, buf, n, tw);
+    else
+      aes.encrypt_blocks(buf, buf, n, tw);
+    write_all(out_fd, buf, 16 * n);
+    have -= 16 * n;
+    memmove(buf, buf + 16 * n, have);
+    blocks += n;
+  }
+}
+
+/// @brief True when fd is a pipe (or FIFO)
+inline bool is_pipe(int fd) {
+  struct stat st;
+  return fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+}
+
+/// @brief crypt_stream for a pipe on out_fd: the output is built in
+/// page-aligned buffers that vmsplice maps into the pipe, saving the copy
+/// write() makes. Reads are sized so that every splice but the last is
+/// exactly CHUNK bytes of whole pages. Each chunk gets a freshly mapped
+/// buffer that is unmapped, never rewritten, once spliced: the pipe holds
+/// its own references to the pages, and a consumer may keep them well past
+/// the pipe (splicing them on, e.g. pv into another pipe), so reusing a
+/// buffer would change output already handed over. Falls back to write()
+/// (and one reused buffer) if the kernel refuses vmsplice.
+template <bool Decrypt, typename Cipher>
+void crypt_stream_vmsplice(const Cipher &aes, int in_fd, int out_fd,
+                           const uint8_t *tweak) {
+  // A bigger pipe means fewer, larger splices; the resize may be refused
+  fcntl(out_fd, F_SETPIPE_SZ, static_cast<int>(CHUNK));
+  constexpr size_t STRIDE = CHUNK + 4096; // room for the held-back bytes
+
+  bool spliced = true; // false once vmsplice failed: plain writes
+  auto emit = [&](const uint8_t *buf, size_t len) {
+    iovec iov = {const_cast<uint8_t *>(buf), len};
+    while (spliced && iov.iov_len > 0) {
+      const ssize_t n = vmsplice(out_fd, &iov, 1, 0);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0 && (errno == EINVAL || errno == ENOSYS || errno == EPERM)) {
+        spliced = false;
+        break;
+      }
+      if (n < 0)
+        throw std::runtime_error(std::string("vmsplice failed: ") +
+                                 strerror(errno));
+      iov.iov_base = static_cast<uint8_t *>(iov.iov_base) + n;
+      iov.iov_len -= static_cast<size_t>(n);
+    }
+    write_all(out_fd, static_cast<const uint8_t *>(iov.iov_base),
+              iov.iov_len);
+  };
+
+  std::unique_ptr<uring::Buffers> chunk;
+  uint8_t held[HOLD_BACK]; // tail of the previous chunk
+  size_t have = 0;
+  uint8_t block_tweak[16];
+  ReadAhead read_ahead(in_fd);
+  for (uint64_t seq = 0;; ++seq) {
+    if (spliced || !chunk)
+      chunk.reset(new uring::Buffers(STRIDE)); // unmaps the spliced one
+    uint8_t *buf = chunk->base;
+    memcpy(buf, held, have);
+    const size_t want = CHUNK + HOLD_BACK - have;
+    const size_t got = read_full(in_fd, buf + have, want);
+    read_ahead.advance(got);
+    have += got;
+    const uint64_t blocks = seq * (CHUNK / 16);
+    if (tweak)
+      cts::tweak_at(tweak, blocks, block_tweak);
+    const uint8_t *tw = tweak ? block_tweak : nullptr;
+
+    if (got < want) {
+      // EOF: the last chunk, any length may go out
+      if (Decrypt)
+        aes.decrypt(buf, buf, have, tw);
+      else
+        aes.encrypt(buf, buf, have, tw);
+      emit(buf, have);
+      return;
+    }
+
+    // have == CHUNK + 31: exactly CHUNK bytes of blocks, 31 held back
+    if (Decrypt)
+      aes.decrypt_blocks(buf, buf, CHUNK / 16, tw);
+    else
+      aes.encrypt_blocks(buf, buf, CHUNK / 16, tw);
+    memcpy(held, buf + CHUNK, HOLD_BACK);
+    emit(buf, CHUNK);
+    have = HOLD_BACK;
+  }
+}
+
+/// @brief crypt_stream on several threads, for pipes that cannot be split
+/// by offset. A reader thread fills CHUNK sized slots of a ring, workers claim
+/// chunks in order and process chunk k at tweak + k * CHUNK / 16, and the
+/// calling thread writes them back strictly in order.
+/// @note Every chunk but the last is exactly CHUNK bytes, so only the last
+/// one can need ciphertext stealing. The reader therefore holds each chunk
+/// back until the next read shows whether it was the last; a final read of
+/// under 16 bytes is appended to the held chunk, which then becomes the
+/// last one. Output and errors match crypt_stream exactly; memory use is
+/// (2 * workers + 2) chunks. With workers = 1 this is the overlapped
+/// single-core mode: the reader, the cipher and the writer each own one of
+/// the four buffers at a time, so I/O latency hides behind the AES work.
+template <bool Decrypt, typename Cipher>
+void crypt_stream_parallel(const Cipher &aes, int in_fd, int out_fd,
+                           const uint8_t *tweak, unsigned workers) {
+  // A slot's state is 4 * chunk number + phase, so a stale phase of an
+  // earlier lap around the ring never matches
+  enum : uint64_t { FREE = 0, FILLED = 1, DONE = 2 };
+  struct Slot {
+    std::vector<uint8_t> data = std::vector<uint8_t>(CHUNK + 16);
+    size_t size = 0;
+    bool last = false;
+    std::atomic<uint64_t> state{0};
+  };
+  const size_t ring = 2 * size_t(workers) + 2;
+  std::vector<Slot> slots(ring);
+  for (size_t i = 0; i < ring; ++i)
+    slots[i].state.store(4 * i + FREE, std::memory_order_relaxed);
+  auto in_phase = [](const Slot &s, uint64_t k, uint64_t phase) {
+    return s.state.load(std::memory_order_acquire) == 4 * k + phase;
+  };
+
+  parallel::EventCount events;
+  std::atomic<uint64_t> claimed{0};          // next chunk for a worker
+  std::atomic<uint64_t> total{UINT64_MAX};   // chunk count, known at EOF
+  std::atomic<bool> failed{false};
+  std::exception_ptr error;
+  auto fail = [&](std::exception_ptr e) {
+    if (!failed.exchange(true))
+      error = e;
+    events.notify();
+  };
+  auto publish = [&](Slot &s, uint64_t k, bool last) {
+    s.last = last;
+    s.state.store(4 * k + FILLED, std::memory_order_release);
+    events.notify();
+  };
+
+  auto reader = [&] {
+    try {
+      ReadAhead read_ahead(in_fd);
+      Slot *held = nullptr; // chunk seq - 1, not known to be last yet
+      for (uint64_t seq = 0;; ++seq) {
+        Slot &s = slots[seq % ring];
+        events.await([&] { return failed || in_phase(s, seq, FREE); });
+        if (failed)
+          return;
+        s.size = read_full(in_fd, s.data.data(), CHUNK);
+        read_ahead.advance(s.size);
+        if (s.size == CHUNK) {
+          if (held)
+            publish(*held, seq - 1, false);
+          held = &s;
+          continue;
+        }
+
+        // EOF: too short a tail cannot stand alone, stealing needs the
+        // block before it
+        if (held && s.size < 16) {
+          memcpy(held->data.data() + CHUNK, s.data.data(), s.size);
+          held->size += s.size;
+          total = seq;
+          publish(*held, seq - 1, true);
+        } else {
+          total = seq + 1;
+          if (held)
+            publish(*held, seq - 1, false);
+          publish(s, seq, true);
+        }
+        return;
+      }
+    } catch (...) {
+      fail(std::current_exception());
+    }
+  };
+
+  auto worker = [&] {
+    try {
+      const Cipher local(aes); // own context, shared key schedule
+      uint8_t chunk_tweak[16];
+      for (;;) {
+        const uint64_t k = claimed.fetch_add(1);
+        Slot &s = slots[k % ring];
+        events.await(
+            [&] { return failed || k >= total || in_phase(s, k, FILLED); });
+        if (failed || !in_phase(s, k, FILLED))
+          return;
+
+        if (tweak)
+          cts::tweak_at(tweak, k * (CHUNK / 16), chunk_tweak);
+        const uint8_t *tw = tweak ? chunk_tweak : nullptr;
+        uint8_t *buf = s.data.data();
+        if (!s.last && Decrypt)
+          local.decrypt_blocks(buf, buf, s.size / 16, tw);
+        else if (!s.last)
+          local.encrypt_blocks(buf, buf, s.size / 16, tw);
+        else if (Decrypt)
+          local.decrypt(buf, buf, s.size, tw);
+        else
+          local.encrypt(buf, buf, s.size, tw);
+        s.state.store(4 * k + DONE, std::memory_order_release);
+        events.notify();
+      }
+    } catch (...) {
+      fail(std::current_exception());
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.emplace_back(reader);
+  for (unsigned w = 0; w < workers; ++w)
+    threads.emplace_back(worker);
+
+  // Writer: chunk k goes out once it and everything before it is done
+  try {
+    for (uint64_t k = 0;; ++k) {
+      Slot &s = slots[k % ring];
+      events.await(
+          [&] { return failed || k >= total || in_phase(s, k, DONE); });
+      if (failed || !in_phase(s, k, DONE))
+        break;
+      write_all(out_fd, s.data.data(), s.size);
+      s.state.store(4 * (k + ring) + FREE, std::memory_order_release);
+      events.notify();
+    }
+  } catch (...) {
+    fail(std::current_exception());
+  }
+
+  for (auto &t : threads)
+    t.join();
+  if (error)
+    std::rethrow_exception(error);
+}
+
+// ============= Command line =============
+
+/// @brief Options shared by the encrypt/decrypt tools
+struct Options {
+  std::string engine = "table"; // --engine (software tools only)
+  std::string in_path;          // --in FILE (with --out)
+  std::string out_path;         // --out FILE
+  std::string in_place_path;    // --in-place FILE
+  unsigned jobs = 1;            // -j N threads (0: one per core)
+  bool overlap = false;         // --overlap: threaded I/O with -j 1
+  std::string io = "mmap";      // --io mmap|uring (file modes)
+  bool direct = false;          // --direct: O_DIRECT (file modes)
+  bool vmsplice = false;        // --vmsplice: zero-copy stdout pipe
+  bool range = false;           // --offset / --length given (decrypt)
+  uint64_t offset = 0;          // --offset: first plaintext byte
+  uint64_t length = UINT64_MAX; // --length: bytes (default: to the end)
+  bool container = false;       // --container: chunked container format
+  uint64_t chunk_size = CHUNK;  // --chunk-size: container chunk bytes
+  std::vector<char *> args;     // argv[0] and the positional arguments
+};
+
+/// @brief Pulls the options out of argv; they may appear anywhere and
+/// everything else stays positional, in order
+/// @param with_engine Accept --engine (the software tools)
+/// @return Error message, empty on success
+inline std::string parse_options(int argc, char *argv[], bool with_engine,
+                                 Options &opt) {
+  opt.args.assign(1, argv[0]);
+  std::string jobs, offset, length, chunk_size;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    std::string *value = nullptr;
+    if (arg == "--overlap") {
+      opt.overlap = true;
+      continue;
+    }
+    if (arg == "--direct") {
+      opt.direct = true;
+      continue;
+    }
+    if (arg == "--vmsplice") {
+      opt.vmsplice = true;
+      continue;
+    }
+    if (arg == "--container") {
+      opt.container = true;
+      continue;
+    }
+    if (arg == "--engine" && with_engine)
+      value = &opt.engine;
+    else if (arg == "--in")
+      value = &opt.in_path;
+    else if (arg == "--out")
+      value = &opt.out_path;
+    else if (arg == "--in-place")
+      value = &opt.in_place_path;
+    else if (arg == "-j" || arg == "--jobs")
+      value = &jobs;
+    else if (arg == "--io")
+      value = &opt.io;
+    else if (arg == "--offset")
+      value = &offset;
+    else if (arg == "--length")
+      value = &length;
+    else if (arg == "--chunk-size")
+      value = &chunk_size;
+
+    if (!value) {
+      opt.args.push_back(argv[i]);
+      continue;
+    }
+    if (i + 1 >= argc)
+      return "Option " + arg + " needs a value";
+    *value = argv[++i];
+  }
+
+  if (!jobs.empty()) {
+    // -j 0 means one thread per core
+    char *end = nullptr;
+    const unsigned long n = strtoul(jobs.c_str(), &end, 10);
+    if (*end != '\0' || jobs[0] == '-' || n > 4096)
+      return "Invalid thread count '" + jobs + "'";
+    opt.jobs = static_cast<unsigned>(n);
+    if (opt.jobs == 0)
+      opt.jobs = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  // Plain decimal byte counts
+  auto parse_bytes = [](const std::string &text, uint64_t &out) {
+    char *end = nullptr;
+    errno = 0;
+    out = strtoull(text.c_str(), &end, 10);
+    return !text.empty() && text[0] != '-' && *end == '\0' && errno == 0;
+  };
+  if (!offset.empty() && !parse_bytes(offset, opt.offset))
+    return "Invalid offset '" + offset + "'";
+  if (!length.empty() && !parse_bytes(length, opt.length))
+    return "Invalid length '" + length + "'";
+  opt.range = !offset.empty() || !length.empty();
+  if (opt.range && !opt.in_place_path.empty())
+    return "--offset/--length cannot be combined with --in-place";
+  if (!chunk_size.empty() && !parse_bytes(chunk_size, opt.chunk_size))
+    return "Invalid chunk size '" + chunk_size + "'";
+  if (!chunk_size.empty() && !opt.container)
+    return "--chunk-size needs --container";
+  if (opt.container && (opt.range || opt.direct || !opt.in_place_path.empty()))
+    return "--container cannot be combined with --offset/--length, "
+           "--direct or --in-place";
+
+  if (opt.io != "mmap" && opt.io != "uring")
+    return "Unknown I/O engine '" + opt.io + "' (mmap or uring)";
+  if (opt.in_path.empty() != opt.out_path.empty())
+    return "--in and --out must be given together";
+  if (opt.direct && opt.in_path.empty() && opt.in_place_path.empty())
+    return "--direct needs --in/--out or --in-place";
+  if (!opt.in_place_path.empty() && !opt.in_path.empty())
+    return "--in-place cannot be combined with --in/--out";
+  return "";
+}
+
+// ============= File mode =============
+
+/// @brief Open file descriptor plus its mapping, released on scope exit
+struct FileMap {
+  int fd = -1;
+  uint8_t *data = nullptr;
+  size_t size = 0;
+
+  FileMap() = default;
+  FileMap(const FileMap &) = delete;
+  FileMap &operator=(const FileMap &) = delete;
+  ~FileMap() {
+    if (data)
+      munmap(data, size);
+    if (fd >= 0)
+      close(fd);
+  }
+};
+
+[[noreturn]] inline void fail(const std::string &what,
+                              const std::string &path) {
+  throw std::runtime_error(what + " '" + path + "': " + strerror(errno));
+}
+
+inline void open_file(FileMap &f, const std::string &path, int flags) {
+  f.fd = ::open(path.c_str(), flags | O_CLOEXEC, 0666);
+  if (f.fd < 0)
+    fail("Cannot open", path);
+}
+
+inline size_t file_size(const FileMap &f, const std::string &path) {
+  struct stat st;
+  if (fstat(f.fd, &st) != 0)
+    fail("Cannot stat", path);
+  return static_cast<size_t>(st.st_size);
+}
+
+/// @brief Maps f.size bytes (nothing for an empty file) with a sequential
+/// access hint, so the kernel reads ahead aggressively and drops pages
+/// behind the cipher
+inline void map_file(FileMap &f, const std::string &path, int prot) {
+  if (f.size == 0)
+    return;
+  void *p = mmap(nullptr, f.size, prot, MAP_SHARED, f.fd, 0);
+  if (p == MAP_FAILED)
+    fail("Cannot mmap", path);
+  f.data = static_cast<uint8_t *>(p);
+  madvise(p, f.size, MADV_SEQUENTIAL);
+}
+
+/// @brief Reserves size bytes for a new output file (fallocate, else
+/// ftruncate)
+inline void size_file(const FileMap &f, const std::string &path,
+                      size_t size) {
+  if (size != 0 && fallocate(f.fd, 0, 0, static_cast<off_t>(size)) != 0 &&
+      ftruncate(f.fd, static_cast<off_t>(size)) != 0)
+    fail("Cannot size", path);
+}
+
+/// @brief --io uring: the io_uring engine, or plain read/write on kernels
+/// without io_uring
+/// @param out_path Reopened for the fallback when in place (out_fd ==
+/// in_fd), so that reads and writes keep separate file offsets
+template <bool Decrypt, typename Cipher>
+void crypt_fds(const Cipher &aes, int in_fd, int out_fd, size_t size,
+               const uint8_t *tweak, const std::string &out_path) {
+  if (uring::crypt_file<Decrypt>(aes, in_fd, out_fd, size, tweak))
+    return;
+  FileMap out;
+  if (out_fd == in_fd) {
+    open_file(out, out_path, O_WRONLY);
+    out_fd = out.fd;
+  }
+  crypt_stream<Decrypt>(aes, in_fd, out_fd, tweak);
+}
+
+// O_DIRECT needs buffers, offsets and lengths aligned to the logical block
+// size of the device (512 or 4096 bytes); 4096 covers both
+constexpr size_t DIRECT_ALIGN = 4096;
+
+/// @brief --direct: everything up to an aligned boundary goes through
+/// O_DIRECT descriptors and never enters the page cache; the last 16..4111
+/// bytes, which hold the unaligned ciphertext-stealing tail, go through the
+/// ordinary (buffered) in_fd / out_fd
+/// @param out_fd Equal to in_fd for in place (then out_path is in_path)
+template <bool Decrypt, typename Cipher>
+void crypt_direct(const Cipher &aes, int in_fd, int out_fd,
+                  const std::string &in_path, const std::string &out_path,
+                  size_t size, const uint8_t *tweak) {
+  const bool in_place = in_fd == out_fd;
+  const size_t body =
+      size < 16 ? 0 : (size - 16) / DIRECT_ALIGN * DIRECT_ALIGN;
+
+  if (body != 0) {
+    FileMap din, dout;
+    open_file(din, in_path, (in_place ? O_RDWR : O_RDONLY) | O_DIRECT);
+    if (!in_place)
+      open_file(dout, out_path, O_WRONLY | O_DIRECT);
+    const int dout_fd = in_place ? din.fd : dout.fd;
+
+    // Queued through io_uring, else one aligned chunk at a time
+    if (!uring::crypt_file<Decrypt>(aes, din.fd, dout_fd, body, tweak,
+                                    false)) {
+      uring::Buffers buffer(CHUNK);
+      uint8_t chunk_tweak[16];
+      for (size_t off = 0; off < body; off += CHUNK) {
+        const size_t n = std::min(CHUNK, body - off);
+        pread_full(din.fd, buffer.base, n, off);
+        if (tweak)
+          cts::tweak_at(tweak, off / 16, chunk_tweak);
+        const uint8_t *tw = tweak ? chunk_tweak : nullptr;
+        if (Decrypt)
+          aes.decrypt_blocks(buffer.base, buffer.base, n / 16, tw);
+        else
+          aes.encrypt_blocks(buffer.base, buffer.base, n / 16, tw);
+        pwrite_all(dout_fd, buffer.base, n, off);
+      }
+    }
+  }
+
+  if (size == body)
+    return;
+  uint8_t tail[DIRECT_ALIGN + 16];
+  uint8_t tail_tweak[16];
+  const size_t n = size - body;
+  pread_full(in_fd, tail, n, body);
+  if (tweak)
+    cts::tweak_at(tweak, body / 16, tail_tweak);
+  const uint8_t *tw = tweak ? tail_tweak : nullptr;
+  if (Decrypt)
+    aes.decrypt(tail, tail, n, tw);
+  else
+    aes.encrypt(tail, tail, n, tw);
+  pwrite_all(out_fd, tail, n, body);
+}
+
+/// @brief Encrypts (or decrypts) a file over one read-write mapping (or
+/// through io_uring with --io uring): no second copy on disk or in memory
+/// @note Not crash-safe: an interrupted run leaves a partly rewritten file
+template <bool Decrypt, typename Cipher>
+void crypt_in_place(const Cipher &aes, const std::string &path,
+                    const uint8_t *tweak, const Options &opt) {
+  FileMap f;
+  open_file(f, path, O_RDWR);
+  f.size = file_size(f, path);
+  cts::check_length(f.size);
+  if (opt.direct) {
+    crypt_direct<Decrypt>(aes, f.fd, f.fd, path, path, f.size, tweak);
+    return;
+  }
+  if (opt.io == "uring") {
+    crypt_fds<Decrypt>(aes, f.fd, f.fd, f.size, tweak, path);
+    return;
+  }
+  map_file(f, path, PROT_READ | PROT_WRITE);
+  parallel::crypt<Decrypt>(aes, f.data, f.data, f.size, tweak, opt.jobs);
+}
+
+/// @brief Encrypts (or decrypts) in_path into out_path, mapping both files
+/// (or through io_uring with --io uring)
+/// @note The output is sized up front (fallocate, else ftruncate); with the
+/// blocks reserved, writeback through the mapping cannot hit ENOSPC, which
+/// a store to a mapping has no way to report
+template <bool Decrypt, typename Cipher>
+void crypt_file(const Cipher &aes, const std::string &in_path,
+                const std::string &out_path, const uint8_t *tweak,
+                const Options &opt) {
+  FileMap in;
+  open_file(in, in_path, O_RDONLY);
+  in.size = file_size(in, in_path);
+  cts::check_length(in.size); // before the output is created
+
+  struct stat in_st, out_st;
+  if (fstat(in.fd, &in_st) == 0 && stat(out_path.c_str(), &out_st) == 0 &&
+      in_st.st_dev == out_st.st_dev && in_st.st_ino == out_st.st_ino) {
+    // O_TRUNC would destroy the input: same file means in place
+    crypt_in_place<Decrypt>(aes, in_path, tweak, opt);
+    return;
+  }
+
+  FileMap out;
+  open_file(out, out_path, O_RDWR | O_CREAT | O_TRUNC);
+  out.size = in.size;
+  size_file(out, out_path, out.size);
+  if (opt.direct) {
+    crypt_direct<Decrypt>(aes, in.fd, out.fd, in_path, out_path, in.size,
+                          tweak);
+    return;
+  }
+  if (opt.io == "uring") {
+    crypt_fds<Decrypt>(aes, in.fd, out.fd, in.size, tweak, out_path);
+    return;
+  }
+
+  map_file(in, in_path, PROT_READ);
+  map_file(out, out_path, PROT_READ | PROT_WRITE);
+  parallel::crypt<Decrypt>(aes, in.data, out.data, in.size, tweak, opt.jobs);
+}
+
+/// @brief --offset/--length: decrypts only the requested plaintext range of
+/// a seekable ciphertext (--in FILE, or stdin redirected from a file) to
+/// --out or stdout. The input is mapped and only the blocks covering the
+/// range (plus the last two, when it reaches the stealing tail) are read.
+/// @throws std::runtime_error for a pipe or other unseekable input,
+/// std::out_of_range for an offset past the end
+template <typename Cipher>
+void decrypt_range(const Cipher &aes, const Options &opt,
+                   const uint8_t *tweak) {
+  const std::string in_path = opt.in_path.empty() ? "stdin" : opt.in_path;
+  FileMap in;
+  if (opt.in_path.empty())
+    in.fd = dup(STDIN_FILENO);
+  else
+    open_file(in, in_path, O_RDONLY);
+  struct stat st;
+  if (in.fd < 0 || fstat(in.fd, &st) != 0 || !S_ISREG(st.st_mode))
+    throw std::runtime_error("--offset/--length need a seekable input "
+                             "(--in FILE or a redirected file)");
+  in.size = static_cast<size_t>(st.st_size);
+  cts::check_length(in.size);
+  if (opt.offset > in.size)
+    throw std::out_of_range("Offset lies past the end of the input");
+  const size_t count = static_cast<size_t>(
+      std::min<uint64_t>(opt.length, in.size - opt.offset));
+
+  FileMap out;
+  int out_fd = STDOUT_FILENO;
+  if (!opt.out_path.empty()) {
+    open_file(out, opt.out_path, O_WRONLY | O_CREAT | O_TRUNC);
+    out_fd = out.fd;
+  }
+  if (in.size == 0)
+    return;
+  map_file(in, in_path, PROT_READ);
+
+  // Piecewise, so a huge range still needs only one CHUNK of memory
+  std::vector<uint8_t> buffer(std::min(count, CHUNK));
+  for (size_t done = 0; done < count;) {
+    const size_t n = std::min(CHUNK, count - done);
+    aes.decrypt_range(in.data, in.size, opt.offset + done, n, buffer.data(),
+                      tweak);
+    write_all(out_fd, buffer.data(), n);
+    done += n;
+  }
+}
+
+// ============= Container =============
+
+/// @brief --container, encrypting: stdin or --in into a container on
+/// stdout or --out, written chunk by chunk. A bad chunk size or a short
+/// regular input is rejected before --out is created; any later failure
+/// removes the partial --out
+template <typename Cipher>
+void container_encrypt(const Cipher &aes, const Options &opt,
+                       const uint8_t *tweak) {
+  container::check_chunk_size(opt.chunk_size);
+  if (opt.in_path.empty()) {
+    container::write(aes, STDIN_FILENO, STDOUT_FILENO, tweak, opt.chunk_size);
+    return;
+  }
+
+  FileMap in, out;
+  open_file(in, opt.in_path, O_RDONLY);
+  struct stat in_st, out_st;
+  if (fstat(in.fd, &in_st) != 0)
+    fail("Cannot stat", opt.in_path);
+  if (S_ISREG(in_st.st_mode))
+    cts::check_length(static_cast<size_t>(in_st.st_size));
+  if (stat(opt.out_path.c_str(), &out_st) == 0 &&
+      in_st.st_dev == out_st.st_dev && in_st.st_ino == out_st.st_ino)
+    throw std::invalid_argument("--container needs a separate output file");
+  open_file(out, opt.out_path, O_WRONLY | O_CREAT | O_TRUNC);
+  try {
+    container::write(aes, in.fd, out.fd, tweak, opt.chunk_size);
+  } catch (...) {
+    unlink(opt.out_path.c_str());
+    throw;
+  }
+}
+
+/// @brief --container, decrypting. A seekable input (--in, or stdin
+/// redirected from a file) is mapped and opened through its index: with
+/// --out every chunk goes straight into the mapped output on -j threads,
+/// otherwise the chunks are written to stdout in order. A pipe is read
+/// frame by frame into --out or stdout.
+/// @param tweak Caller's tweak, nullptr to use the container's
+template <typename Cipher>
+void container_decrypt(const Cipher &aes, const Options &opt,
+                       const uint8_t *tweak) {
+  const std::string in_path = opt.in_path.empty() ? "stdin" : opt.in_path;
+  FileMap in;
+  if (opt.in_path.empty())
+    in.fd = dup(STDIN_FILENO);
+  else
+    open_file(in, in_path, O_RDONLY);
+  struct stat st;
+  if (in.fd < 0 || fstat(in.fd, &st) != 0)
+    fail("Cannot stat", in_path);
+  if (!S_ISREG(st.st_mode)) {
+    FileMap out;
+    int out_fd = STDOUT_FILENO;
+    if (!opt.out_path.empty()) {
+      open_file(out, opt.out_path, O_WRONLY | O_CREAT | O_TRUNC);
+      out_fd = out.fd;
+    }
+    container::read_stream(aes, in.fd, out_fd, tweak);
+    return;
+  }
+
+  in.size = static_cast<size_t>(st.st_size);
+  if (in.size == 0)
+    throw std::runtime_error("Not a T-AES container");
+  map_file(in, in_path, PROT_READ);
+  const container::Reader reader(in.data, in.size);
+  const uint8_t *base = container::resolve_tweak(reader.header(), aes, tweak);
+
+  if (!opt.out_path.empty()) {
+    FileMap out;
+    open_file(out, opt.out_path, O_RDWR | O_CREAT | O_TRUNC);
+    out.size = reader.plaintext_size();
+    if (out.size == 0)
+      return;
+    size_file(out, opt.out_path, out.size);
+    map_file(out, opt.out_path, PROT_READ | PROT_WRITE);
+    reader.decrypt_all(aes, out.data, base, opt.jobs);
+    return;
+  }
+  std::vector<uint8_t> buffer(reader.header().chunk_size + 15);
+  for (uint64_t k = 0; k < reader.chunk_count(); ++k) {
+    reader.decrypt_chunk(aes, k, buffer.data(), base);
+    write_all(STDOUT_FILENO, buffer.data(), reader.chunk_length(k));
+  }
+}
+
+/// @brief Runs the mode selected by opt: --offset/--length, --container,
+/// --in-place, --in/--out, or stdin to stdout (pipelined with -j N > 1 or
+/// --overlap, spliced with --vmsplice when stdout is a pipe)
+template <bool Decrypt, typename Cipher>
+void run(const Cipher &aes, const Options &opt, const uint8_t *tweak) {
+  if (opt.range && !Decrypt)
+    throw std::invalid_argument("--offset/--length are for decryption only");
+  if (opt.range)
+    decrypt_range(aes, opt, tweak);
+  else if (opt.container && Decrypt)
+    container_decrypt(aes, opt, tweak);
+  else if (opt.container)
+    container_encrypt(aes, opt, tweak);
+  else if (!opt.in_place_path.empty())
+    crypt_in_place<Decrypt>(aes, opt.in_place_path, tweak, opt);
+  else if (!opt.in_path.empty())
+    crypt_file<Decrypt>(aes, opt.in_path, opt.out_path, tweak, opt);
+  else if (opt.jobs > 1 || opt.overlap)
+    crypt_stream_parallel<Decrypt>(aes, STDIN_FILENO, STDOUT_FILENO, tweak,
+                                   opt.jobs);
+  else if (opt.vmsplice && is_pipe(STDOUT_FILENO))
+    crypt_stream_vmsplice<Decrypt>(aes, STDIN_FILENO, STDOUT_FILENO, tweak);
+  else
+    crypt_stream<Decrypt>(aes, STDIN_FILENO, STDOUT_FILENO, tweak);
+}
+
+} // namespace stream_io
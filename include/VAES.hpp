@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <immintrin.h>
+
+// VAES kernels: the same T-AES rounds as AESNI::encrypt_lanes/decrypt_lanes,
+// but each aesenc/aesdec works on 2 (ymm) or 4 (zmm) blocks at once.
+// Compiled with per-function target attributes so the binary keeps the
+// AES-NI baseline; only call these after best_aes_kernel() selected them.
+//
+// keys: direction-specific schedule (forward keys for encryption,
+// equivalent-inverse keys for decryption, first/last round keys unmodified)
+// tweaked: one round key per block for TweakRound (ignored unless Tweaked)
+// Rounds/TweakRound are template constants (see KeyTraits), so the round
+// loops unroll fully and the tweak round is picked at compile time.
+// (512-bit round keys use the zero-masked broadcast: the unmasked form trips
+// GCC 12 -Wuninitialized inside avx512fintrin.h)
+
+namespace vaes {
+
+constexpr int REGS = 8; // independent registers in flight per round
+constexpr size_t BLOCKS_256 = 2 * REGS;
+constexpr size_t BLOCKS_512 = 4 * REGS;
+
+template <bool Decrypt, int Rounds, int TweakRound, bool Tweaked>
+__attribute__((target("vaes,avx2"))) void
+blocks_256(const uint8_t *in, uint8_t *out, const __m128i *keys,
+           const __m128i *tweaked) {
+  __m256i s[REGS];
+  constexpr int first = Decrypt ? Rounds : 0;
+  constexpr int last = Decrypt ? 0 : Rounds;
+
+  __m256i rk = _mm256_broadcastsi128_si256(keys[first]);
+  for (int j = 0; j < REGS; ++j)
+    s[j] = _mm256_xor_si256(
+        _mm256_loadu_si256((const __m256i *)(in + 32 * j)), rk);
+
+#pragma GCC unroll 16
+  for (int i = 1; i < Rounds; ++i) {
+    const int round = Decrypt ? Rounds - i : i;
+    if (Tweaked && round == TweakRound) {
+      for (int j = 0; j < REGS; ++j) {
+        __m256i tk = _mm256_loadu_si256((const __m256i *)(tweaked + 2 * j));
+        s[j] = Decrypt ? _mm256_aesdec_epi128(s[j], tk)
+                       : _mm256_aesenc_epi128(s[j], tk);
+      }
+    } else {
+      rk = _mm256_broadcastsi128_si256(keys[round]);
+      for (int j = 0; j < REGS; ++j)
+        s[j] = Decrypt ? _mm256_aesdec_epi128(s[j], rk)
+                       : _mm256_aesenc_epi128(s[j], rk);
+    }
+  }
+
+  rk = _mm256_broadcastsi128_si256(keys[last]);
+  for (int j = 0; j < REGS; ++j)
+    _mm256_storeu_si256((__m256i *)(out + 32 * j),
+                        Decrypt ? _mm256_aesdeclast_epi128(s[j], rk)
+                                : _mm256_aesenclast_epi128(s[j], rk));
+}
+
+template <bool Decrypt, int Rounds, int TweakRound, bool Tweaked>
+__attribute__((target("vaes,avx512f"))) void
+blocks_512(const uint8_t *in, uint8_t *out, const __m128i *keys,
+           const __m128i *tweaked) {
+  __m512i s[REGS];
+  constexpr int first = Decrypt ? Rounds : 0;
+  constexpr int last = Decrypt ? 0 : Rounds;
+
+  __m512i rk = _mm512_maskz_broadcast_i32x4(0xFFFF, keys[first]);
+  for (int j = 0; j < REGS; ++j)
+    s[j] = _mm512_xor_si512(_mm512_loadu_si512(in + 64 * j), rk);
+
+#pragma GCC unroll 16
+  for (int i = 1; i < Rounds; ++i) {
+    const int round = Decrypt ? Rounds - i : i;
+    if (Tweaked && round == TweakRound) {
+      for (int j = 0; j < REGS; ++j) {
+        __m512i tk = _mm512_loadu_si512(tweaked + 4 * j);
+        s[j] = Decrypt ? _mm512_aesdec_epi128(s[j], tk)
+                       : _mm512_aesenc_epi128(s[j], tk);
+      }
+    } else {
+      rk = _mm512_maskz_broadcast_i32x4(0xFFFF, keys[round]);
+      for (int j = 0; j < REGS; ++j)
+        s[j] = Decrypt ? _mm512_aesdec_epi128(s[j], rk)
+                       : _mm512_aesenc_epi128(s[j], rk);
+    }
+  }
+
+  rk = _mm512_maskz_broadcast_i32x4(0xFFFF, keys[last]);
+  for (int j = 0; j < REGS; ++j)
+    _mm512_storeu_si512(out + 64 * j,
+                        Decrypt ? _mm512_aesdeclast_epi128(s[j], rk)
+                                : _mm512_aesenclast_epi128(s[j], rk));
+}
+
+} // namespace vaes
@@ -21,6 +21,19 @@ namespace utils {
     }
   }
 
+  /// @brief Advance the tweak by n blocks (tweak += n)
+  /// @param tweak The tweak value to advance
+  /// @param n Number of blocks to skip
+  /// @note Same big-endian numbering as increment_tweak, without n iterations
+  void advance_tweak(std::vector<uint8_t> &tweak, uint64_t n) {
+    assert(tweak.size() == 16);
+    for (int i = 15; i >= 0 && n != 0; --i) {
+      uint64_t sum = static_cast<uint64_t>(tweak[i]) + (n & 0xFF);
+      tweak[i] = static_cast<uint8_t>(sum & 0xFF);
+      n = (n >> 8) + (sum >> 8);
+    }
+  }
+
 /// @brief Conversion from char to uint8_t for encryption operations
 /// @param block Input character block
 /// @return 128 bits of 16 bytes of 8 bit integers
@@ -34,6 +47,18 @@ std::vector<uint8_t> convertToBlock(char *block, size_t size) {
   return bformatted;
 }
 
+/// @brief Reads a stream until EOF into one contiguous buffer
+/// @param in Input stream (stdin for the CLI tools)
+/// @return All bytes read
+std::vector<uint8_t> read_all(std::istream &in) {
+  std::vector<uint8_t> data;
+  char chunk[1 << 16];
+  while (in.read(chunk, sizeof(chunk)) || in.gcount() > 0) {
+    data.insert(data.end(), chunk, chunk + in.gcount());
+  }
+  return data;
+}
+
 uint8_t xtime(uint8_t x) { return (x << 1) ^ ((x & 0x80) ? 0x1b : 0x00); }
 
 /// @brief Print a vector of any integer type
@@ -1,4 +1,5 @@
 #include "../include/AESNI.hpp"
+#include "../include/StreamIO.hpp"
 #include "../include/utils.hpp"
 #include <cstdint>
 #include <cstdlib>
@@ -12,9 +13,22 @@ bool TWEAK = false;
 
 int main(int argc, char *argv[]) {
 
+  // Options may appear anywhere; the rest is positional
+  stream_io::Options opt;
+  const string opt_error = stream_io::parse_options(argc, argv, false, opt);
+  if (!opt_error.empty()) {
+    cerr << opt_error << endl;
+    return 1;
+  }
+  argc = static_cast<int>(opt.args.size());
+  argv = opt.args.data();
+
   if (argc < 3) {
     cout << "Required arguments: <aes_size (128 | 192 | 256)> <password> "
-            "<tweak_password?>"
+            "<tweak_password?> [--in FILE --out FILE | --in-place FILE] "
+            "[-j N] [--overlap] "
+            "[--io mmap|uring] [--direct] [--vmsplice] "
+            "[--offset N] [--length N] [--container]"
          << endl;
     return 1;
   }
@@ -39,24 +53,6 @@ int main(int argc, char *argv[]) {
       TWEAK ? reinterpret_cast<const unsigned char *>(argv[3]) : nullptr;
   const unsigned long int tweak_length = TWEAK ? strlen(argv[3]) : 0;
 
-  vector<vector<uint8_t>> all_blocks;
-
-  // A block has 128bit = 128/8 => 16 bytes or 16 chars
-  char block[16]{};
-  int current_block_size = 0;
-  // read all the bytes from the stdin until EOF
-  while (true) {
-    cin.read(block, 16);
-    current_block_size = static_cast<size_t>(cin.gcount());
-    if (current_block_size == 0)
-      break;
-    vector<uint8_t> converted =
-        utils::convertToBlock(block, current_block_size);
-    all_blocks.push_back(converted);
-    if (current_block_size < 16)
-      break; // EOF reached or last block
-  }
-
   unsigned int key_size, n_rounds;
 
   switch (size) {
@@ -99,82 +95,13 @@ int main(int argc, char *argv[]) {
   // Constructor will throw runtime_error if CPU doesn't support AES-NI
   AESNI aes_ni(key_size, n_rounds, key, tweak);
 
-  // Ciphertext stealing decryption
-  vector<vector<uint8_t>> plainBlocks;
-  vector<uint8_t> tweak_for_block = tweak;
-
-  for (size_t i = 0; i < all_blocks.size(); i++) {
-    vector<uint8_t> current_block = all_blocks.at(i);
-    vector<uint8_t> plaintext_block;
-
-    // Check if NEXT block exists and is partial (skip normal decrypt of current)
-    if (i + 1 < all_blocks.size() && all_blocks.at(i + 1).size() < 16) {
-      // Current block contains merged data, will handle in next iteration
-      // Just increment tweak and continue
-      if (TWEAK) {
-        utils::increment_tweak(tweak_for_block);
-      }
-      continue;
-    }
-
-    // Check if THIS is the last block and it's partial (ciphertext stealing)
-    if (current_block.size() < 16 && i == all_blocks.size() - 1) {
-      // Ciphertext stealing decryption with merged blocks:
-      // - previous block contains: truncated_C(n-1) + head_of_Cn
-      // - current block contains: tail_of_Cn
-      size_t partial_size = current_block.size();
-      size_t steal_size = 16 - partial_size;
-
-      // Get the previous block (contains merged data)
-      vector<uint8_t> previous_block = all_blocks.at(i - 1);
-
-      // Reconstruct full Cn from: last steal_size bytes of previous + current
-      vector<uint8_t> full_cn(previous_block.end() - steal_size,
-                              previous_block.end());
-      full_cn.insert(full_cn.end(), current_block.begin(), current_block.end());
-
-      // Step 1: Decrypt Cn to get (Pn || tail of original C(n-1))
-      vector<uint8_t> decrypted_cn = aes_ni.decrypt_block(full_cn);
-
-      // Step 2: Extract stolen bytes from tail of decrypted Cn
-      vector<uint8_t> stolen_bytes(decrypted_cn.end() - steal_size,
-                                    decrypted_cn.end());
-
-      // Step 3: Reconstruct full C(n-1) from first partial_size bytes of previous + stolen
-      vector<uint8_t> truncated_cn1(previous_block.begin(),
-                                     previous_block.begin() + partial_size);
-      truncated_cn1.insert(truncated_cn1.end(), stolen_bytes.begin(),
-                           stolen_bytes.end());
-
-      // Step 4: Decrypt full C(n-1) to get P(n-1)
-      vector<uint8_t> pn1 = aes_ni.decrypt_block(truncated_cn1);
-
-      // Step 5: Extract Pn (first partial_size bytes of decrypted Cn)
-      vector<uint8_t> pn(decrypted_cn.begin(),
-                         decrypted_cn.begin() + partial_size);
-
-      // Add both plaintext blocks
-      plainBlocks.push_back(pn1);
-      plainBlocks.push_back(pn);
-
-      if (TWEAK) {
-        utils::increment_tweak(tweak_for_block);
-        utils::increment_tweak(tweak_for_block);
-      }
-    } else {
-      // Normal full block decryption
-      plaintext_block = aes_ni.decrypt_block(current_block);
-      plainBlocks.push_back(plaintext_block);
-
-      if (TWEAK) {
-        utils::increment_tweak(tweak_for_block);
-      }
-    }
-  }
-
-  // Output decrypted bytes as raw binary
-  for (size_t i = 0; i < plainBlocks.size(); i++) {
-    cout.write(reinterpret_cast<const char*>(plainBlocks[i].data()), plainBlocks[i].size());
+  // stdin/stdout is streamed in 1 MiB chunks (only the last 16..31 bytes
+  // wait for EOF); --in/--out and --in-place work on mmap'd files
+  try {
+    stream_io::run<true>(aes_ni, opt, tweak.empty() ? nullptr : tweak.data());
+  } catch (const exception &e) {
+    cerr << e.what() << endl;
+    return 1;
   }
 
   return 0;
@@ -1,4 +1,5 @@
 #include "../include/AESNI.hpp"
+#include "../include/StreamIO.hpp"
 #include "../include/utils.hpp"
 #include <cstdint>
 #include <cstdlib>
@@ -13,9 +14,22 @@ bool TWEAK = false;
 
 int main(int argc, char *argv[]) {
 
+  // Options may appear anywhere; the rest is positional
+  stream_io::Options opt;
+  const string opt_error = stream_io::parse_options(argc, argv, false, opt);
+  if (!opt_error.empty()) {
+    cerr << opt_error << endl;
+    return 1;
+  }
+  argc = static_cast<int>(opt.args.size());
+  argv = opt.args.data();
+
   if (argc < 3) {
     cout << "Required arguments: <aes_size (128 | 192 | 256)> <password> "
-            "<tweak_password?>"
+            "<tweak_password?> [--in FILE --out FILE | --in-place FILE] "
+            "[-j N] [--overlap] "
+            "[--io mmap|uring] [--direct] [--vmsplice] "
+            "[--container [--chunk-size N]]"
          << endl;
     return 1;
   }
@@ -40,24 +54,6 @@ int main(int argc, char *argv[]) {
       TWEAK ? reinterpret_cast<const unsigned char *>(argv[3]) : nullptr;
   const unsigned long int tweak_length = TWEAK ? strlen(argv[3]) : 0;
 
-  vector<vector<uint8_t>> all_blocks;
-
-  // A block has 128bit = 128/8 => 16 bytes or 16 chars
-  char block[16]{};
-  int current_block_size = 0;
-  // read all the bytes from the stdin until EOF
-  while (true) {
-    cin.read(block, 16);
-    current_block_size = static_cast<size_t>(cin.gcount());
-    if (current_block_size == 0)
-      break;
-    vector<uint8_t> converted =
-        utils::convertToBlock(block, current_block_size);
-    all_blocks.push_back(converted);
-    if (current_block_size < 16)
-      break; // EOF reached or last block
-  }
-
   unsigned int key_size, n_rounds;
 
   switch (size) {
@@ -103,47 +99,13 @@ int main(int argc, char *argv[]) {
   // Constructor will throw runtime_error if CPU doesn't support AES-NI
   AESNI aes_ni(key_size, n_rounds, key, tweak);
 
-  // tweak part added
-  vector<vector<uint8_t>> cipherBlocks;
-  vector<uint8_t> tweak_for_block = tweak;
-
-  for (size_t i = 0; i < all_blocks.size(); i++) {
-    vector<uint8_t> current_block = all_blocks.at(i);
-    vector<uint8_t> ciphertext_block;
-    if (current_block.size() < 16) {
-      // ciphertext stealing
-      size_t steal_size = 16 - current_block.size();
-      vector<uint8_t> previous_encrypted_block = cipherBlocks.at(i - 1);
-      // this is the last bytes that are copied from the cipher of the Cn-1 block to append to the plaintext of the Pn block
-      vector<uint8_t> cipher_to_append(previous_encrypted_block.end() -
-                                           steal_size,
-                                       previous_encrypted_block.end());
-
-      current_block.insert(current_block.end(), cipher_to_append.begin(),
-                           cipher_to_append.end());
-      // new last block (leftover of the ciphertext of the previous block n-1 )
-      vector<uint8_t> new_last_block(previous_encrypted_block.begin(),
-                                     previous_encrypted_block.end() -
-                                         steal_size);
-      ciphertext_block = aes_ni.encrypt_block(current_block);
-      cipherBlocks[i - 1] = new_last_block;  // Replace C(n-1) with truncated version
-      cipherBlocks.push_back(ciphertext_block);  // Add Cn at the end
-
-    } else {
-      ciphertext_block = aes_ni.encrypt_block(current_block);
-      cipherBlocks.push_back(ciphertext_block);
-    }
-
-    if (TWEAK) {
-      utils::increment_tweak(tweak_for_block);
-    }
-  }
-
-  // cout << endl << "Encrypted bytes:" << endl; // COMMENT THIS OUT
-  for (size_t i = 0; i < cipherBlocks.size(); i++) {
-    // utils::printVector(cipherBlocks[i]); // COMMENT THIS OUT
-    cout.write(reinterpret_cast<const char *>(cipherBlocks[i].data()),
-               cipherBlocks[i].size());
+  // stdin/stdout is streamed in 1 MiB chunks (only the last 16..31 bytes
+  // wait for EOF); --in/--out and --in-place work on mmap'd files
+  try {
+    stream_io::run<false>(aes_ni, opt, tweak.empty() ? nullptr : tweak.data());
+  } catch (const exception &e) {
+    cerr << e.what() << endl;
+    return 1;
   }
 
   return 0;
@@ -1,5 +1,21 @@
 // Speed benchmark comparing T-AES vs OpenSSL XTS
 // Measurements exclude key setup as per assignment requirements
+//
+// Every case (engine x key size x tweak mode x direction) builds its context
+// once, before timing, and encrypts in place over a buffer generated up
+// front for each requested size. Samples are single calls timed with the
+// TSC after a warmup (see Bench.hpp); the table reports the latency
+// distribution, throughput at the median, cycles per byte and the
+// throughput as a percentage of memcpy over the same size, which stands in
+// for the memory bandwidth at that working set (L1 up to DRAM).
+//
+// --json writes the same results with the host and build they came from,
+// and --compare checks them against such a file from an earlier run,
+// flagging cases whose median got significantly slower.
+//
+// --scaling runs the same cases on 1..N threads pinned one per CPU, each
+// with a private context or all sharing one, and reports the aggregate
+// throughput curve next to memcpy's, to size worker pools.
 
 #include <iostream>
 #include <vector>
@@ -7,483 +23,874 @@
 #include <cstring>
 #include <cstdio>
 #include <fstream>
+#include <functional>
 #include <iomanip>
-#include <limits>
-#include <time.h>
+#include <map>
+#include <memory>
 #include <random>
 #include <algorithm>
+#include <thread>
+#include <sstream>
+#include <ctime>
+#include <sys/utsname.h>
+#include <unistd.h>
+#include <openssl/crypto.h>
 #include <openssl/evp.h>
 #include "../include/AES.hpp"
+#include "../include/AESBitslice.hpp"
+#include "../include/AESVperm.hpp"
 #include "../include/AESNI.hpp"
+#include "../include/Bench.hpp"
+#include "../include/Json.hpp"
+#include "../include/PerfCounters.hpp"
 #include "../include/utils.hpp"
 
 using namespace std;
 
-constexpr size_t BUFFER_SIZE = 4096;  // 4KB buffer (one memory page)
-constexpr int ITERATIONS = 100000;     // At least 100k measurements per spec
-
-// Generate random data from /dev/urandom
-void generate_random_buffer(uint8_t* buffer, size_t size) {
-    FILE* urandom = fopen("/dev/urandom", "rb");
-    if (urandom) {
-        size_t read = fread(buffer, 1, size, urandom);
-        fclose(urandom);
-        if (read < size) {
-            std::random_device rd;
-            for (size_t i = read; i < size; ++i) buffer[i] = static_cast<uint8_t>(rd());
+// The compile flags, passed in by the Makefile, for the JSON report
+#ifndef TAES_BUILD_FLAGS
+#define TAES_BUILD_FLAGS "unknown"
+#endif
+
+// OpenSSL caps one XTS data unit at 2^20 blocks; larger buffers are split
+constexpr size_t XTS_UNIT = size_t(16) << 20;
+
+// ============= Options =============
+struct Options {
+    vector<string> engines = {"sw", "bs", "vp", "ni", "xts"};
+    vector<int> keys = {128, 192, 256};
+    vector<bool> tweaks = {false, true};
+    vector<bool> decrypts = {false, true};
+    vector<size_t> sizes = {4096};
+    bench::Config cfg;
+    string csv = "benchmark_results_comparison.csv";
+    bool scaling = false;     // --scaling: thread-scaling mode
+    unsigned max_threads = 0; // its largest thread count (0: one per CPU)
+    bool perf = false;        // --perf: hardware counters per case
+    string json;              // --json: report file
+    string compare;           // --compare: baseline report
+    double threshold = 5;     // --threshold: smallest change flagged, in %
+    unsigned runs = 0;        // --runs: runs per case (0: 5 with --json or
+                              // --compare, 1 otherwise)
+};
+
+void usage(const char* prog) {
+    cout << "Usage: " << prog << " [options]\n"
+         << "  --engines LIST   sw,bs,vp,ni,xts (default: all)\n"
+         << "  --keys LIST      128,192,256 (default: all; XTS runs 128/256)\n"
+         << "  --tweak MODE     on, off or both (default: both)\n"
+         << "  --ops LIST       enc,dec (default: both)\n"
+         << "  --sizes LIST     buffer sizes, K/M/G suffixes (default: 4K)\n"
+         << "  --sweep          sizes 16 B to 1 GiB in steps of 4x\n"
+         << "  --min-time SEC   measure each case at least this long (0.2)\n"
+         << "  --min-iters N    at least N samples per case (5)\n"
+         << "  --max-iters N    at most N samples per case (100000)\n"
+         << "  --warmup SEC     untimed calls before sampling (0.05)\n"
+         << "  --runs N         independent runs per case, interleaved (1; 5 with\n"
+         << "                   --json or --compare)\n"
+         << "  --perf           hardware counters per case (perf_event_open)\n"
+         << "  --csv FILE       results file (benchmark_results_comparison.csv)\n"
+         << "  --json FILE      also write a JSON report (host, build, distributions)\n"
+         << "  --compare FILE   flag regressions against a --json report\n"
+         << "  --threshold PCT  smallest significant change for --compare (5)\n"
+         << "  --scaling N|all  throughput on 1..N pinned threads (all: one per CPU)\n";
+}
+
+vector<string> split(const string& text) {
+    vector<string> parts;
+    size_t start = 0;
+    for (size_t comma; (comma = text.find(',', start)) != string::npos; start = comma + 1)
+        parts.push_back(text.substr(start, comma - start));
+    parts.push_back(text.substr(start));
+    return parts;
+}
+
+// Returns an error message, empty on success
+string parse_options(int argc, char* argv[], Options& opt) {
+    for (int i = 1; i < argc; i++) {
+        const string arg = argv[i];
+        if (arg == "--sweep") {
+            opt.sizes.clear();
+            for (size_t s = 16; s <= (size_t(1) << 30); s *= 4)
+                opt.sizes.push_back(s);
+            continue;
+        }
+        if (arg == "--perf") {
+            opt.perf = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+            return "Unknown option or missing value: " + arg;
+        const string value = argv[++i];
+        char* end = nullptr;
+        if (arg == "--engines") {
+            opt.engines = split(value);
+            for (const auto& e : opt.engines)
+                if (e != "sw" && e != "bs" && e != "vp" && e != "ni" && e != "xts")
+                    return "Unknown engine '" + e + "'";
+        } else if (arg == "--keys") {
+            opt.keys.clear();
+            for (const auto& k : split(value)) {
+                if (k != "128" && k != "192" && k != "256")
+                    return "Key size must be 128, 192 or 256";
+                opt.keys.push_back(stoi(k));
+            }
+        } else if (arg == "--tweak") {
+            if (value == "on") opt.tweaks = {true};
+            else if (value == "off") opt.tweaks = {false};
+            else if (value == "both") opt.tweaks = {false, true};
+            else return "--tweak takes on, off or both";
+        } else if (arg == "--ops") {
+            opt.decrypts.clear();
+            for (const auto& o : split(value)) {
+                if (o != "enc" && o != "dec")
+                    return "Unknown operation '" + o + "' (enc or dec)";
+                opt.decrypts.push_back(o == "dec");
+            }
+        } else if (arg == "--sizes") {
+            opt.sizes.clear();
+            for (const auto& s : split(value)) {
+                size_t size;
+                if (!bench::parse_size(s, size) || size < 16)
+                    return "Invalid size '" + s + "' (16 bytes or more)";
+                opt.sizes.push_back(size);
+            }
+        } else if (arg == "--min-time" || arg == "--warmup") {
+            const double sec = strtod(value.c_str(), &end);
+            if (*end != '\0' || !(sec >= 0))
+                return "Invalid time '" + value + "'";
+            (arg == "--min-time" ? opt.cfg.min_time : opt.cfg.warmup_time) = sec;
+        } else if (arg == "--min-iters" || arg == "--max-iters") {
+            const unsigned long long n = strtoull(value.c_str(), &end, 10);
+            if (*end != '\0' || value[0] == '-' || n == 0)
+                return "Invalid iteration count '" + value + "'";
+            (arg == "--min-iters" ? opt.cfg.min_iters : opt.cfg.max_iters) = n;
+        } else if (arg == "--csv") {
+            opt.csv = value;
+        } else if (arg == "--json") {
+            opt.json = value;
+        } else if (arg == "--compare") {
+            opt.compare = value;
+        } else if (arg == "--runs") {
+            const unsigned long n = strtoul(value.c_str(), &end, 10);
+            if (*end != '\0' || value[0] == '-' || n == 0 || n > 1000)
+                return "Invalid run count '" + value + "'";
+            opt.runs = static_cast<unsigned>(n);
+        } else if (arg == "--threshold") {
+            const double pct = strtod(value.c_str(), &end);
+            if (*end != '\0' || !(pct >= 0))
+                return "Invalid threshold '" + value + "'";
+            opt.threshold = pct;
+        } else if (arg == "--scaling") {
+            opt.scaling = true;
+            if (value != "all") {
+                const unsigned long n = strtoul(value.c_str(), &end, 10);
+                if (*end != '\0' || value[0] == '-' || n == 0 || n > 4096)
+                    return "Invalid thread count '" + value + "'";
+                opt.max_threads = static_cast<unsigned>(n);
+            }
+        } else {
+            return "Unknown option: " + arg;
         }
     }
+    if (opt.cfg.min_iters > opt.cfg.max_iters)
+        return "--min-iters exceeds --max-iters";
+    if (opt.scaling && (!opt.json.empty() || !opt.compare.empty()))
+        return "--json and --compare do not apply to --scaling";
+    if (opt.runs == 0)
+        opt.runs = opt.json.empty() && opt.compare.empty() ? 1 : 5;
+    return "";
+}
+
+// ============= Cases =============
+using Op = function<void(uint8_t*, size_t)>;
+
+// One configuration under test: run() is a single in-place call on the
+// given buffer, with the context (key schedule, OpenSSL state) built once.
+// make_context() builds another context from the same key, for threads
+// that each get their own
+struct Case {
+    string name;
+    Op run;
+    function<Op()> make_context;
+    bool shareable; // run() may be called from several threads at once
+};
+
+vector<uint8_t> random_bytes(size_t n) {
+    static mt19937_64 rng(random_device{}());
+    vector<uint8_t> bytes(n);
+    for (auto& b : bytes) b = static_cast<uint8_t>(rng());
+    return bytes;
 }
 
-void generate_random_key(uint8_t* key, size_t size) {
-    generate_random_buffer(key, size);
+// T-AES engines are immutable after construction, so one can be shared
+template <typename Engine>
+Case taes_case(const string& tag, int bits, bool with_tweak, bool decrypt) {
+    const vector<uint8_t> key = random_bytes(bits / 8);
+    vector<uint8_t> tweak;
+    if (with_tweak) tweak = random_bytes(16);
+    Case c;
+    c.name = "T-AES " + tag + (decrypt ? " Decrypt " : " Encrypt ") + to_string(bits) +
+             (with_tweak ? " tweak" : " no-tweak");
+    c.make_context = [=]() -> Op {
+        auto aes = make_shared<const Engine>(bits, KeySchedule::rounds_for(bits), key, tweak);
+        if (decrypt)
+            return [aes](uint8_t* buf, size_t sz) { aes->decrypt(buf, buf, sz); };
+        return [aes](uint8_t* buf, size_t sz) { aes->encrypt(buf, buf, sz); };
+    };
+    c.run = c.make_context();
+    c.shareable = true;
+    return c;
 }
 
-// High-precision timing using clock_gettime (nanosecond precision)
-uint64_t get_time_ns() {
-    struct timespec ts;
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+// An EVP_CIPHER_CTX is mutable state: one per thread, never shared
+Case xts_case(int bits, bool decrypt) {
+    const vector<uint8_t> key = random_bytes(bits / 4); // two AES keys
+    Case c;
+    c.name = "OpenSSL XTS-" + to_string(bits) + (decrypt ? " Decrypt" : " Encrypt");
+    c.make_context = [=]() -> Op {
+        uint8_t iv[16] = {0}; // XTS requires an IV (tweak)
+        shared_ptr<EVP_CIPHER_CTX> ctx(EVP_CIPHER_CTX_new(), EVP_CIPHER_CTX_free);
+        EVP_CipherInit_ex(ctx.get(), bits == 128 ? EVP_aes_128_xts() : EVP_aes_256_xts(),
+                          nullptr, key.data(), iv, decrypt ? 0 : 1);
+        return [ctx](uint8_t* buf, size_t sz) {
+            // Units of XTS_UNIT bytes; a remainder under one block borrows one
+            for (size_t off = 0; off < sz;) {
+                size_t len = min(XTS_UNIT, sz - off);
+                if (sz - off - len != 0 && sz - off - len < 16) len -= 16;
+                int outlen;
+                EVP_CipherUpdate(ctx.get(), buf + off, &outlen, buf + off,
+                                 static_cast<int>(len));
+                off += len;
+            }
+        };
+    };
+    c.run = c.make_context();
+    c.shareable = false;
+    return c;
 }
 
-// ============= T-AES Software Wrappers (key setup excluded from timing) =============
-void tAES_SW_encrypt_no_keygen(uint8_t* buffer, size_t size, AES* aes) {
-    for (size_t i = 0; i < size; i += 16) {
-        vector<uint8_t> block(buffer + i, buffer + i + 16);
-        vector<uint8_t> encrypted = aes->encrypt_block(block);
-        memcpy(buffer + i, encrypted.data(), 16);
+vector<Case> make_cases(const Options& opt) {
+    auto wanted = [&](const string& e) {
+        return find(opt.engines.begin(), opt.engines.end(), e) != opt.engines.end();
+    };
+    const CPUFeatures& cpu = cpu_features();
+    vector<Case> cases;
+    for (int bits : opt.keys) {
+        for (bool with_tweak : opt.tweaks) {
+            for (bool decrypt : opt.decrypts) {
+                if (wanted("sw")) cases.push_back(taes_case<AES>("SW", bits, with_tweak, decrypt));
+                if (wanted("bs")) cases.push_back(taes_case<AESBitslice>("BS", bits, with_tweak, decrypt));
+                if (wanted("vp") && cpu.ssse3) cases.push_back(taes_case<AESVperm>("VP", bits, with_tweak, decrypt));
+                if (wanted("ni") && cpu.aesni) cases.push_back(taes_case<AESNI>("NI", bits, with_tweak, decrypt));
+            }
+        }
     }
+    if (wanted("xts")) {
+        for (int bits : opt.keys) {
+            if (bits == 192) continue; // no XTS-192
+            for (bool decrypt : opt.decrypts)
+                cases.push_back(xts_case(bits, decrypt));
+        }
+    }
+    return cases;
 }
 
-void tAES_SW_decrypt_no_keygen(uint8_t* buffer, size_t size, AES* aes) {
-    for (size_t i = 0; i < size; i += 16) {
-        vector<uint8_t> block(buffer + i, buffer + i + 16);
-        vector<uint8_t> decrypted = aes->decrypt_block(block);
-        memcpy(buffer + i, decrypted.data(), 16);
+// ============= Results =============
+struct Result {
+    string name;
+    size_t size = 0;
+    bench::Stats stats;
+    double memcpy_gbps = 0; // memcpy at the same size
+    perf::Reading counters; // over all samples, when --perf
+    vector<double> run_p50; // median of each run, ns
+    double p50_lo = 0, p50_hi = 0; // 95% CI of p50, see set_interval()
+
+    // Across runs (bootstrap over their medians) when there are several;
+    // with one run only the noise within it is covered
+    void set_interval() {
+        if (run_p50.size() > 1)
+            bench::bootstrap_median_ci(run_p50, p50_lo, p50_hi);
+        else
+            p50_lo = stats.p50_lo, p50_hi = stats.p50_hi;
+    }
+
+    // Counter value per byte processed across the samples, -1 if not counted
+    double per_byte(perf::Event e) const {
+        return counters.has(e) ? counters.value[e] / (double(stats.n) * size) : -1;
     }
+
+    double throughput_gbps() const { return size / stats.p50; } // bytes/ns
+    double cycles_per_byte() const { return stats.median_ticks / size; }
+    double pct_memcpy() const { return 100.0 * throughput_gbps() / memcpy_gbps; }
+};
+
+const int NAME_W = 34; // width for operation name
+const int NUM_W = 12;  // width for numeric columns
+
+void print_header() {
+    cout << left << setw(NAME_W) << "Operation" << right << setw(9) << "Size" << setw(8) << "N"
+         << setw(NUM_W) << "p50 (μs)" << setw(NUM_W) << "p90 (μs)" << setw(NUM_W) << "p99 (μs)"
+         << setw(NUM_W) << "p99.9 (μs)" << setw(NUM_W) << "GB/s" << setw(NUM_W) << "cyc/B"
+         << setw(NUM_W) << "% memcpy" << "\n";
+    cout << string(NAME_W + 17 + 7 * NUM_W, '-') << "\n";
+}
+
+void print_row(const Result& r) {
+    const bench::Stats& s = r.stats;
+    cout << left << setw(NAME_W) << r.name << right << setw(9) << bench::format_size(r.size)
+         << setw(8) << s.n << fixed << setprecision(3) << setw(NUM_W) << s.p50 / 1000
+         << setw(NUM_W) << s.p90 / 1000 << setw(NUM_W) << s.p99 / 1000
+         << setw(NUM_W) << s.p999 / 1000 << setw(NUM_W) << r.throughput_gbps()
+         << setprecision(2) << setw(NUM_W) << r.cycles_per_byte()
+         << setprecision(1) << setw(NUM_W) << r.pct_memcpy() << endl;
 }
 
-// ============= T-AES AES-NI Wrappers (key setup excluded from timing) =============
-void tAES_NI_encrypt_no_keygen(uint8_t* buffer, size_t size, AESNI* aes_ni) {
-    for (size_t i = 0; i < size; i += 16) {
-        vector<uint8_t> block(buffer + i, buffer + i + 16);
-        vector<uint8_t> encrypted = aes_ni->encrypt_block(block);
-        memcpy(buffer + i, encrypted.data(), 16);
+// Counters per byte (instructions, cycles) or per KiB (misses, faults), so
+// that rows of different sizes compare; "-" where the event was not counted
+void print_counters_header() {
+    cout << left << setw(NAME_W) << "Operation" << right << setw(9) << "Size"
+         << setw(NUM_W) << "instr/B" << setw(NUM_W) << "cyc/B" << setw(NUM_W) << "IPC"
+         << setw(NUM_W) << "L1D miss/K" << setw(NUM_W) << "LLC miss/K"
+         << setw(NUM_W) << "br miss/K" << setw(NUM_W) << "faults/K" << "\n";
+    cout << string(NAME_W + 9 + 7 * NUM_W, '-') << "\n";
+}
+
+void print_counter(double value, int precision) {
+    if (value < 0)
+        cout << setw(NUM_W) << "-";
+    else
+        cout << fixed << setprecision(precision) << setw(NUM_W) << value;
+}
+
+void print_counters_row(const Result& r) {
+    cout << left << setw(NAME_W) << r.name << right << setw(9) << bench::format_size(r.size);
+    print_counter(r.per_byte(perf::INSTRUCTIONS), 2);
+    print_counter(r.per_byte(perf::CYCLES), 2);
+    const perf::Reading& c = r.counters;
+    print_counter(c.has(perf::INSTRUCTIONS) && c.has(perf::CYCLES) && c.value[perf::CYCLES] > 0
+                      ? c.value[perf::INSTRUCTIONS] / c.value[perf::CYCLES] : -1, 2);
+    for (perf::Event e : {perf::L1D_MISSES, perf::LLC_MISSES, perf::BRANCH_MISSES,
+                          perf::PAGE_FAULTS}) {
+        const double v = r.per_byte(e);
+        print_counter(v < 0 ? v : v * 1024, 3);
     }
+    cout << endl;
 }
 
-void tAES_NI_decrypt_no_keygen(uint8_t* buffer, size_t size, AESNI* aes_ni) {
-    for (size_t i = 0; i < size; i += 16) {
-        vector<uint8_t> block(buffer + i, buffer + i + 16);
-        vector<uint8_t> decrypted = aes_ni->decrypt_block(block);
-        memcpy(buffer + i, decrypted.data(), 16);
+void write_csv(const string& path, const vector<Result>& results) {
+    ofstream csv(path);
+    csv << "Operation,Size,Iterations,Min_ns,Mean_ns,P50_ns,P90_ns,P99_ns,P999_ns,Max_ns,"
+           "Throughput_GBps,Cycles_per_byte,Pct_memcpy";
+    for (int e = 0; e < perf::NUM_EVENTS; ++e)
+        csv << ",perf_" << perf::event_name(perf::Event(e)) << "_per_byte";
+    csv << "\n";
+    for (const auto& r : results) {
+        const bench::Stats& s = r.stats;
+        csv << r.name << "," << r.size << "," << s.n << "," << s.min << "," << s.mean << ","
+            << s.p50 << "," << s.p90 << "," << s.p99 << "," << s.p999 << "," << s.max << ","
+            << r.throughput_gbps() << "," << r.cycles_per_byte() << "," << r.pct_memcpy();
+        // Empty where the event was not counted
+        for (int e = 0; e < perf::NUM_EVENTS; ++e) {
+            csv << ",";
+            if (r.counters.has(perf::Event(e)))
+                csv << r.per_byte(perf::Event(e));
+        }
+        csv << "\n";
     }
 }
 
-// ============= OpenSSL XTS Wrappers (key setup excluded from timing) =============
-void openssl_xts_encrypt_no_keygen(uint8_t* buffer, size_t size, EVP_CIPHER_CTX* ctx) {
-    int outlen;
-    uint8_t outbuf[BUFFER_SIZE];
-    EVP_EncryptUpdate(ctx, outbuf, &outlen, buffer, size);
-    memcpy(buffer, outbuf, size);
+// ============= JSON report and comparison =============
+// Schema "taes-speed/1": {schema, timestamp, host{...}, build{...},
+// config{...}, results[{name, size, n, min/mean/stddev/max_ns, p50/p90/
+// p99/p999_ns, p50_ci95_ns[lo, hi], percentiles_ns[101], throughput_gbps,
+// cycles_per_byte, pct_memcpy, counters_per_byte{event: value}}]}
+const char* const SCHEMA = "taes-speed/1";
+
+// What the numbers depend on besides the code under test
+struct Environment {
+    string cpu_model, cpu_flags, kernel, hostname;
+    string compiler, build_flags, openssl, aes_kernel, bitslice_width;
+
+    static Environment probe() {
+        Environment env;
+        ifstream cpuinfo("/proc/cpuinfo");
+        string line;
+        while (getline(cpuinfo, line) && (env.cpu_model.empty() || env.cpu_flags.empty())) {
+            const size_t colon = line.find(':');
+            if (colon == string::npos || colon + 2 > line.size())
+                continue;
+            if (line.compare(0, 10, "model name") == 0 && env.cpu_model.empty())
+                env.cpu_model = line.substr(colon + 2);
+            else if (line.compare(0, 5, "flags") == 0 && env.cpu_flags.empty())
+                env.cpu_flags = line.substr(colon + 2);
+        }
+        struct utsname u;
+        if (uname(&u) == 0) {
+            env.kernel = string(u.sysname) + " " + u.release + " " + u.machine;
+            env.hostname = u.nodename;
+        }
+#if defined(__clang__)
+        env.compiler = "clang " __clang_version__;
+#elif defined(__GNUC__)
+        env.compiler = "gcc " __VERSION__;
+#else
+        env.compiler = "unknown";
+#endif
+        env.build_flags = TAES_BUILD_FLAGS;
+        env.openssl = OpenSSL_version(OPENSSL_VERSION);
+        env.aes_kernel = aes_kernel_name(best_aes_kernel());
+        env.bitslice_width = AESBitslice::width_name();
+        return env;
+    }
+
+    // The fields a comparison should warn about when they differ
+    vector<pair<string, string>> comparable() const {
+        return {{"cpu_model", cpu_model}, {"kernel", kernel}, {"compiler", compiler},
+                {"build_flags", build_flags}, {"openssl", openssl},
+                {"aes_kernel", aes_kernel}, {"bitslice_width", bitslice_width}};
+    }
+};
+
+string utc_timestamp() {
+    const time_t now = time(nullptr);
+    struct tm tm;
+    char buf[32];
+    gmtime_r(&now, &tm);
+    strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", &tm);
+    return buf;
 }
 
-void openssl_xts_decrypt_no_keygen(uint8_t* buffer, size_t size, EVP_CIPHER_CTX* ctx) {
-    int outlen;
-    uint8_t outbuf[BUFFER_SIZE];
-    EVP_DecryptUpdate(ctx, outbuf, &outlen, buffer, size);
-    memcpy(buffer, outbuf, size);
+void write_json(const string& path, const Environment& env, const Options& opt,
+                const vector<Result>& results) {
+    ofstream out(path);
+    if (!out)
+        throw runtime_error("Cannot write " + path);
+    out << setprecision(10);
+    out << "{\n  \"schema\": " << json::quote(SCHEMA) << ",\n"
+        << "  \"timestamp\": " << json::quote(utc_timestamp()) << ",\n"
+        << "  \"host\": {\n"
+        << "    \"cpu_model\": " << json::quote(env.cpu_model) << ",\n"
+        << "    \"cpu_flags\": " << json::quote(env.cpu_flags) << ",\n"
+        << "    \"cpu_features\": " << json::quote(cpu_features_string()) << ",\n"
+        << "    \"kernel\": " << json::quote(env.kernel) << ",\n"
+        << "    \"hostname\": " << json::quote(env.hostname) << ",\n"
+        << "    \"tsc_ghz\": " << bench::tsc_ghz() << "\n  },\n"
+        << "  \"build\": {\n"
+        << "    \"compiler\": " << json::quote(env.compiler) << ",\n"
+        << "    \"build_flags\": " << json::quote(env.build_flags) << ",\n"
+        << "    \"openssl\": " << json::quote(env.openssl) << ",\n"
+        << "    \"aes_kernel\": " << json::quote(env.aes_kernel) << ",\n"
+        << "    \"bitslice_width\": " << json::quote(env.bitslice_width) << "\n  },\n"
+        << "  \"config\": {\n"
+        << "    \"min_time\": " << opt.cfg.min_time << ",\n"
+        << "    \"min_iters\": " << opt.cfg.min_iters << ",\n"
+        << "    \"max_iters\": " << opt.cfg.max_iters << ",\n"
+        << "    \"warmup_time\": " << opt.cfg.warmup_time << ",\n"
+        << "    \"runs\": " << opt.runs << "\n  },\n"
+        << "  \"results\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        const bench::Stats& s = r.stats;
+        out << (i ? ",\n" : "\n") << "    {\n"
+            << "      \"name\": " << json::quote(r.name) << ",\n"
+            << "      \"size\": " << r.size << ",\n"
+            << "      \"n\": " << s.n << ",\n"
+            << "      \"min_ns\": " << s.min << ", \"mean_ns\": " << s.mean
+            << ", \"stddev_ns\": " << s.stddev << ", \"max_ns\": " << s.max << ",\n"
+            << "      \"p50_ns\": " << s.p50 << ", \"p90_ns\": " << s.p90
+            << ", \"p99_ns\": " << s.p99 << ", \"p999_ns\": " << s.p999 << ",\n"
+            << "      \"p50_ci95_ns\": [" << r.p50_lo << ", " << r.p50_hi << "],\n"
+            << "      \"p50_ci_method\": "
+            << json::quote(r.run_p50.size() > 1 ? "bootstrap over runs" : "order statistics")
+            << ",\n      \"run_p50_ns\": [";
+        for (size_t k = 0; k < r.run_p50.size(); k++)
+            out << (k ? ", " : "") << r.run_p50[k];
+        out << "],\n"
+            << "      \"percentiles_ns\": [";
+        for (size_t q = 0; q < s.percentiles.size(); q++)
+            out << (q ? ", " : "") << s.percentiles[q];
+        out << "],\n"
+            << "      \"throughput_gbps\": " << r.throughput_gbps() << ",\n"
+            << "      \"cycles_per_byte\": " << r.cycles_per_byte() << ",\n"
+            << "      \"pct_memcpy\": " << r.pct_memcpy() << ",\n"
+            << "      \"counters_per_byte\": {";
+        bool first = true;
+        for (int e = 0; e < perf::NUM_EVENTS; ++e) {
+            if (!r.counters.has(perf::Event(e)))
+                continue;
+            out << (first ? "" : ", ") << json::quote(perf::event_name(perf::Event(e)))
+                << ": " << r.per_byte(perf::Event(e));
+            first = false;
+        }
+        out << "}\n    }";
+    }
+    out << "\n  ]\n}\n";
 }
 
-// ============= Benchmark Function =============
-struct BenchmarkResult {
-    uint64_t min_ns;
-    uint64_t max_ns;
-    uint64_t total_ns;
-    int iterations;
-    
-    double avg_ns() const { return (double)total_ns / iterations; }
-    double throughput_gbps() const {
-        // Throughput based on single operation (avg time for one 4KB buffer)
-        double seconds = avg_ns() / 1e9;
-        double gb = BUFFER_SIZE / (1024.0 * 1024.0 * 1024.0);
-        return gb / seconds;
+// One case of a baseline report
+struct BaselineCase {
+    double p50, p50_lo, p50_hi;
+    size_t runs; // 1: the interval covers noise within one run only
+};
+
+struct Baseline {
+    json::Value report;
+    map<pair<string, size_t>, BaselineCase> cases; // by (name, size)
+
+    static Baseline load(const string& path) {
+        ifstream in(path);
+        if (!in)
+            throw runtime_error("Cannot read baseline " + path);
+        stringstream text;
+        text << in.rdbuf();
+        Baseline b;
+        b.report = json::Value::parse(text.str());
+        if (!b.report["schema"].is_string() || b.report["schema"].as_string() != SCHEMA)
+            throw runtime_error(path + " is not a " + SCHEMA + " report");
+        const json::Value& results = b.report["results"];
+        for (size_t i = 0; i < results.size(); i++) {
+            const json::Value& r = results[i];
+            const json::Value& ci = r["p50_ci95_ns"];
+            if (ci.size() != 2)
+                throw runtime_error(path + ": result " + to_string(i) + " has no p50_ci95_ns");
+            b.cases[{r["name"].as_string(), size_t(r["size"].as_number())}] =
+                {r["p50_ns"].as_number(), ci[0].as_number(), ci[1].as_number(),
+                 max<size_t>(1, r["run_p50_ns"].size())};
+        }
+        return b;
     }
-    double latency_us() const { return avg_ns() / 1000.0; }
 };
 
-template<typename SetupFunc, typename OpFunc>
-BenchmarkResult benchmark_operation(const string& name, SetupFunc setup, OpFunc operation) {
-    BenchmarkResult result;
-    result.min_ns = UINT64_MAX;
-    result.max_ns = 0;
-    result.total_ns = 0;
-    result.iterations = ITERATIONS;
-    
-    cout << "Benchmarking " << name << " (" << ITERATIONS << " iterations)..." << flush;
-    
-    for (int i = 0; i < ITERATIONS; i++) {
-        // Generate random data and key for this iteration
-        uint8_t buffer[BUFFER_SIZE];
-        generate_random_buffer(buffer, BUFFER_SIZE);
-        
-        // Setup (not timed)
-        auto ctx = setup();
-        
-        // Measure only the operation (not key setup)
-        uint64_t start = get_time_ns();
-        operation(buffer, BUFFER_SIZE, ctx);
-        uint64_t end = get_time_ns();
-        
-        uint64_t elapsed = end - start;
-        result.min_ns = min(result.min_ns, elapsed);
-        result.max_ns = max(result.max_ns, elapsed);
-        result.total_ns += elapsed;
-        
-        // Progress indicator every 10k iterations
-        if ((i + 1) % 10000 == 0) {
-            cout << "." << flush;
+// A case is significantly slower (faster) when the confidence intervals of
+// the two medians do not overlap and the medians differ by more than both
+// the threshold and the run-to-run noise floor, the width of the wider
+// interval relative to its median: one disturbed run widens an interval
+// on one side only and can leave it just clear of the other, so a change
+// has to stand out from the spread as well. Returns the number of
+// regressions.
+size_t compare_results(const Baseline& base, const string& path, const Environment& env,
+                       const vector<Result>& results, double threshold) {
+    cout << "\nCOMPARISON WITH " << path;
+    if (base.report["timestamp"].is_string())
+        cout << " (" << base.report["timestamp"].as_string() << ")";
+    cout << "\n";
+    for (const auto& field : env.comparable()) {
+        const bool host = field.first == "cpu_model" || field.first == "kernel";
+        const json::Value& v = base.report[host ? "host" : "build"][field.first];
+        if (v.is_string() && v.as_string() != field.second)
+            cout << "  Note: " << field.first << " differs: '" << v.as_string() << "' -> '"
+                 << field.second << "'\n";
+    }
+    cout << "  Significant: non-overlapping 95% CIs of the median (bootstrap over runs)"
+         << " and a change over " << threshold << "% and over the wider CI's width\n";
+    bool single_run = false;
+    for (const auto& b : base.cases)
+        single_run |= b.second.runs < 2;
+    for (const Result& r : results)
+        single_run |= r.run_p50.size() < 2;
+    if (single_run)
+        cout << "  Note: some cases have a single run, whose interval misses the noise"
+             << " between runs; use --runs 5 or more on both sides\n";
+    cout << "\n";
+
+    cout << left << setw(NAME_W) << "Operation" << right << setw(9) << "Size"
+         << setw(NUM_W + 7) << "base p50 (μs)" << setw(NUM_W + 8) << "95% CI"
+         << setw(NUM_W + 3) << "now p50 (μs)" << setw(NUM_W + 8) << "95% CI"
+         << setw(NUM_W) << "change" << "  verdict\n";
+    cout << string(NAME_W + 9 + 5 * NUM_W + 32 + 9, '-') << "\n";
+    auto ci = [](double lo, double hi) {
+        ostringstream text;
+        text << fixed << setprecision(3) << "[" << lo / 1000 << ", " << hi / 1000 << "]";
+        return text.str();
+    };
+
+    size_t regressions = 0, improvements = 0, missing = 0;
+    for (const Result& r : results) {
+        auto it = base.cases.find({r.name, r.size});
+        if (it == base.cases.end()) {
+            ++missing;
+            continue;
+        }
+        const BaselineCase& b = it->second;
+        const bench::Stats& s = r.stats;
+        const double change = 100.0 * (s.p50 / b.p50 - 1);
+        string verdict = "~";
+        const double noise = 100.0 * max((b.p50_hi - b.p50_lo) / b.p50,
+                                         (r.p50_hi - r.p50_lo) / s.p50);
+        const double floor = max(threshold, noise);
+        if (r.p50_lo > b.p50_hi && change > floor) {
+            verdict = "REGRESSION";
+            ++regressions;
+        } else if (r.p50_hi < b.p50_lo && -change > floor) {
+            verdict = "faster";
+            ++improvements;
+        }
+        cout << left << setw(NAME_W) << r.name << right << setw(9)
+             << bench::format_size(r.size) << fixed << setprecision(3)
+             << setw(NUM_W + 6) << b.p50 / 1000 << setw(NUM_W + 8) << ci(b.p50_lo, b.p50_hi)
+             << setw(NUM_W + 2) << s.p50 / 1000 << setw(NUM_W + 8) << ci(r.p50_lo, r.p50_hi)
+             << setprecision(1) << setw(NUM_W - 1) << showpos << change << "%" << noshowpos
+             << "  " << verdict << "\n";
+    }
+    cout << "\n" << regressions << " regression(s), " << improvements << " improvement(s)";
+    if (missing)
+        cout << ", " << missing << " case(s) not in the baseline";
+    cout << endl;
+    return regressions;
+}
+
+// ============= Thread scaling =============
+struct ScalingResult {
+    string name;
+    string contexts; // "private", "shared" or "-" (memcpy)
+    size_t size;
+    unsigned threads;
+    double gbps;        // aggregate
+    double single_gbps; // same curve at one thread
+    double memcpy_gbps; // memcpy on as many threads
+
+    double per_thread() const { return gbps / threads; }
+    double efficiency() const { return 100.0 * gbps / (threads * single_gbps); }
+    double pct_memcpy() const { return 100.0 * gbps / memcpy_gbps; }
+};
+
+// 1, 2, 4, ... and the maximum itself
+vector<unsigned> thread_counts(unsigned max_threads) {
+    vector<unsigned> counts;
+    for (unsigned t = 1; t < max_threads; t *= 2) counts.push_back(t);
+    counts.push_back(max_threads);
+    return counts;
+}
+
+void print_scaling_header() {
+    cout << left << setw(NAME_W) << "Operation" << setw(10) << "Contexts" << right
+         << setw(9) << "Size" << setw(8) << "Threads" << setw(NUM_W) << "GB/s"
+         << setw(NUM_W) << "GB/s/thr" << setw(NUM_W) << "Effic. %" << setw(NUM_W)
+         << "% memcpy" << "\n";
+    cout << string(NAME_W + 27 + 4 * NUM_W, '-') << "\n";
+}
+
+void print_scaling_row(const ScalingResult& r) {
+    cout << left << setw(NAME_W) << r.name << setw(10) << r.contexts << right << setw(9)
+         << bench::format_size(r.size) << setw(8) << r.threads << fixed << setprecision(3)
+         << setw(NUM_W) << r.gbps << setw(NUM_W) << r.per_thread() << setprecision(1)
+         << setw(NUM_W) << r.efficiency() << setw(NUM_W) << r.pct_memcpy() << endl;
+}
+
+// The knee of a curve: the first thread count after which doubling adds
+// less than 10%, i.e. where the shared resource (usually memory) saturates
+void print_saturation(const vector<ScalingResult>& curve) {
+    for (size_t i = 0; i + 1 < curve.size(); i++) {
+        if (curve[i + 1].gbps < 1.1 * curve[i].gbps) {
+            cout << "  -> saturates at " << curve[i].threads
+                 << (curve[i].threads == 1 ? " thread (" : " threads (")
+                 << fixed << setprecision(3) << curve[i].gbps << " GB/s, "
+                 << setprecision(1) << curve[i].pct_memcpy() << "% of memcpy)\n";
+            return;
         }
     }
-    
-    cout << " Done!" << endl;
-    return result;
+    cout << "  -> no saturation up to " << curve.back().threads << " threads\n";
+}
+
+vector<ScalingResult> run_scaling(const Options& opt, const vector<Case>& cases) {
+    const vector<int> cpus = bench::allowed_cpus();
+    const unsigned max_threads =
+        opt.max_threads ? opt.max_threads : static_cast<unsigned>(cpus.size());
+    const vector<unsigned> counts = thread_counts(max_threads);
+    if (max_threads > cpus.size())
+        cout << "Note: " << max_threads << " threads on " << cpus.size()
+             << " CPUs, the larger counts are oversubscribed\n\n";
+
+    vector<ScalingResult> results;
+    print_scaling_header();
+    for (size_t size : opt.sizes) {
+        // One curve: make_op(t) builds the operation thread t runs
+        auto curve = [&](const string& name, const string& contexts,
+                         const vector<double>& memcpy_gbps, auto make_op) {
+            vector<ScalingResult> points;
+            for (size_t i = 0; i < counts.size(); i++) {
+                const double gbps = bench::throughput(counts[i], size, opt.cfg.min_time,
+                                                      opt.cfg.warmup_time, cpus, make_op);
+                const double single = points.empty() ? gbps : points[0].gbps;
+                points.push_back({name, contexts, size, counts[i], gbps, single,
+                                  memcpy_gbps.empty() ? gbps : memcpy_gbps[i]});
+                print_scaling_row(points.back());
+            }
+            print_saturation(points);
+            results.insert(results.end(), points.begin(), points.end());
+            return points;
+        };
+
+        auto memcpy_points = curve("memcpy", "-", {}, [&](unsigned) -> Op {
+            auto dst = make_shared<bench::Buffer>(size);
+            memset(dst->data(), 0, size);
+            return [dst](uint8_t* buf, size_t sz) { memcpy(dst->data(), buf, sz); };
+        });
+        vector<double> memcpy_gbps;
+        for (const auto& p : memcpy_points) memcpy_gbps.push_back(p.gbps);
+
+        for (const Case& c : cases) {
+            curve(c.name, "private", memcpy_gbps,
+                  [&](unsigned) { return c.make_context(); });
+            if (c.shareable)
+                curve(c.name, "shared", memcpy_gbps, [&](unsigned) { return c.run; });
+        }
+    }
+    return results;
+}
+
+void write_scaling_csv(const string& path, const vector<ScalingResult>& results) {
+    ofstream csv(path);
+    csv << "Operation,Contexts,Size,Threads,Throughput_GBps,Per_thread_GBps,Efficiency,"
+           "Pct_memcpy\n";
+    for (const auto& r : results) {
+        csv << r.name << "," << r.contexts << "," << r.size << "," << r.threads << ","
+            << r.gbps << "," << r.per_thread() << "," << r.efficiency() << ","
+            << r.pct_memcpy() << "\n";
+    }
 }
 
 // ============= Main =============
-int main() {
+int main(int argc, char* argv[]) {
+    Options opt;
+    const string error = parse_options(argc, argv, opt);
+    if (!error.empty()) {
+        cerr << error << "\n";
+        usage(argv[0]);
+        return 1;
+    }
+    // Read the baseline first, so a bad file fails before the measurements
+    Baseline baseline;
+    if (!opt.compare.empty()) {
+        try {
+            baseline = Baseline::load(opt.compare);
+        } catch (const exception& e) {
+            cerr << e.what() << "\n";
+            return 1;
+        }
+    }
+
     cout << "=============================================================\n";
     cout << "  T-AES vs OpenSSL XTS Performance Benchmark\n";
     cout << "=============================================================\n";
     cout << "Configuration:\n";
-    cout << "  Buffer size: " << BUFFER_SIZE << " bytes (4KB)\n";
-    cout << "  Iterations: " << ITERATIONS << " per operation\n";
-    cout << "  Key sizes: AES-128/192/256 (SW & AES-NI)\n";
-    cout << "  Tweak modes: with-tweak and no-tweak\n";
-    cout << "  XTS: 128-bit and 256-bit\n";
-    cout << "  Timing: clock_gettime (nanosecond precision)\n";
+    cout << "  Buffer sizes:";
+    for (size_t s : opt.sizes) cout << " " << bench::format_size(s);
+    cout << "\n";
+    cout << "  Samples: " << opt.cfg.min_time << " s and " << opt.cfg.min_iters
+         << " calls at least, " << opt.cfg.max_iters << " at most, after "
+         << opt.cfg.warmup_time << " s of warmup\n";
+    cout << "  CPU features: " << cpu_features_string() << "\n";
+    cout << "  AES-NI bulk kernel: " << aes_kernel_name(best_aes_kernel()) << "\n";
+    cout << "  Bitsliced SW width: " << AESBitslice::width_name() << "\n";
+    cout << "  Timing: rdtsc, " << fixed << setprecision(3) << bench::tsc_ghz()
+         << " GHz reference clock (cyc/B in TSC cycles)\n";
     cout << "  Note: Key setup excluded from measurements\n";
     cout << "=============================================================\n\n";
 
-    vector<pair<string, BenchmarkResult>> results;
-
-    // ==================================================================
-    // T-AES Software and AES-NI for 128/192/256, with and without tweak
-    // ==================================================================
-    auto add_taes_sw_suite = [&](int bits, int rounds) {
-        // no-tweak Encrypt
-        cout << "\n[T-AES SW] Encrypt " << bits << " no-tweak\n";
-        auto enc_no_tweak = benchmark_operation(
-            string("T-AES SW Encrypt ") + to_string(bits) + " no-tweak",
-            [&]() {
-                vector<uint8_t> key_vec(bits/8);
-                generate_random_key(key_vec.data(), key_vec.size());
-                vector<uint8_t> tweak_empty; // no tweak
-                return new AES(bits, rounds, key_vec, tweak_empty);
-            },
-            [](uint8_t* buf, size_t sz, AES* aes) {
-                tAES_SW_encrypt_no_keygen(buf, sz, aes);
-                delete aes;
-            }
-        );
-        results.push_back({string("T-AES SW Encrypt ") + to_string(bits) + " no-tweak", enc_no_tweak});
-
-        // no-tweak Decrypt
-        cout << "\n[T-AES SW] Decrypt " << bits << " no-tweak\n";
-        auto dec_no_tweak = benchmark_operation(
-            string("T-AES SW Decrypt ") + to_string(bits) + " no-tweak",
-            [&]() {
-                vector<uint8_t> key_vec(bits/8);
-                generate_random_key(key_vec.data(), key_vec.size());
-                vector<uint8_t> tweak_empty;
-                return new AES(bits, rounds, key_vec, tweak_empty);
-            },
-            [](uint8_t* buf, size_t sz, AES* aes) {
-                tAES_SW_decrypt_no_keygen(buf, sz, aes);
-                delete aes;
-            }
-        );
-        results.push_back({string("T-AES SW Decrypt ") + to_string(bits) + " no-tweak", dec_no_tweak});
-
-        // with-tweak Encrypt
-        cout << "\n[T-AES SW] Encrypt " << bits << " tweak\n";
-        auto enc_tweak = benchmark_operation(
-            string("T-AES SW Encrypt ") + to_string(bits) + " tweak",
-            [&]() {
-                vector<uint8_t> key_vec(bits/8);
-                vector<uint8_t> tweak(16);
-                generate_random_key(key_vec.data(), key_vec.size());
-                generate_random_key(tweak.data(), tweak.size());
-                return new AES(bits, rounds, key_vec, tweak);
-            },
-            [](uint8_t* buf, size_t sz, AES* aes) {
-                tAES_SW_encrypt_no_keygen(buf, sz, aes);
-                delete aes;
-            }
-        );
-        results.push_back({string("T-AES SW Encrypt ") + to_string(bits) + " tweak", enc_tweak});
-
-        // with-tweak Decrypt
-        cout << "\n[T-AES SW] Decrypt " << bits << " tweak\n";
-        auto dec_tweak = benchmark_operation(
-            string("T-AES SW Decrypt ") + to_string(bits) + " tweak",
-            [&]() {
-                vector<uint8_t> key_vec(bits/8);
-                vector<uint8_t> tweak(16);
-                generate_random_key(key_vec.data(), key_vec.size());
-                generate_random_key(tweak.data(), tweak.size());
-                return new AES(bits, rounds, key_vec, tweak);
-            },
-            [](uint8_t* buf, size_t sz, AES* aes) {
-                tAES_SW_decrypt_no_keygen(buf, sz, aes);
-                delete aes;
-            }
-        );
-        results.push_back({string("T-AES SW Decrypt ") + to_string(bits) + " tweak", dec_tweak});
-    };
+    // Opened once; an event the host cannot count is reported and left out
+    unique_ptr<perf::Counters> counters;
+    if (opt.perf && opt.scaling) {
+        cout << "Note: --perf is ignored in scaling mode\n\n";
+    } else if (opt.perf) {
+        counters.reset(new perf::Counters);
+        if (!counters->available()) {
+            cout << "Note: perf counters unavailable (" << counters->error()
+                 << "), continuing without them\n\n";
+            counters.reset();
+        } else if (!counters->error().empty()) {
+            cout << "Note: some perf counters unavailable (first: " << counters->error()
+                 << ")\n\n";
+        }
+    }
 
-    auto add_taes_ni_suite = [&](int bits, int rounds) {
-        // no-tweak Encrypt
-        cout << "\n[T-AES NI] Encrypt " << bits << " no-tweak\n";
-        auto enc_no_tweak = benchmark_operation(
-            string("T-AES NI Encrypt ") + to_string(bits) + " no-tweak",
-            [&]() {
-                vector<uint8_t> key_vec(bits/8);
-                generate_random_key(key_vec.data(), key_vec.size());
-                vector<uint8_t> tweak_empty;
-                return new AESNI(bits, rounds, key_vec, tweak_empty);
-            },
-            [](uint8_t* buf, size_t sz, AESNI* aes) {
-                tAES_NI_encrypt_no_keygen(buf, sz, aes);
-                delete aes;
-            }
-        );
-        results.push_back({string("T-AES NI Encrypt ") + to_string(bits) + " no-tweak", enc_no_tweak});
-
-        // no-tweak Decrypt
-        cout << "\n[T-AES NI] Decrypt " << bits << " no-tweak\n";
-        auto dec_no_tweak = benchmark_operation(
-            string("T-AES NI Decrypt ") + to_string(bits) + " no-tweak",
-            [&]() {
-                vector<uint8_t> key_vec(bits/8);
-                generate_random_key(key_vec.data(), key_vec.size());
-                vector<uint8_t> tweak_empty;
-                return new AESNI(bits, rounds, key_vec, tweak_empty);
-            },
-            [](uint8_t* buf, size_t sz, AESNI* aes) {
-                tAES_NI_decrypt_no_keygen(buf, sz, aes);
-                delete aes;
-            }
-        );
-        results.push_back({string("T-AES NI Decrypt ") + to_string(bits) + " no-tweak", dec_no_tweak});
-
-        // with-tweak Encrypt
-        cout << "\n[T-AES NI] Encrypt " << bits << " tweak\n";
-        auto enc_tweak = benchmark_operation(
-            string("T-AES NI Encrypt ") + to_string(bits) + " tweak",
-            [&]() {
-                vector<uint8_t> key_vec(bits/8);
-                vector<uint8_t> tweak(16);
-                generate_random_key(key_vec.data(), key_vec.size());
-                generate_random_key(tweak.data(), tweak.size());
-                return new AESNI(bits, rounds, key_vec, tweak);
-            },
-            [](uint8_t* buf, size_t sz, AESNI* aes) {
-                tAES_NI_encrypt_no_keygen(buf, sz, aes);
-                delete aes;
-            }
-        );
-        results.push_back({string("T-AES NI Encrypt ") + to_string(bits) + " tweak", enc_tweak});
-
-        // with-tweak Decrypt
-        cout << "\n[T-AES NI] Decrypt " << bits << " tweak\n";
-        auto dec_tweak = benchmark_operation(
-            string("T-AES NI Decrypt ") + to_string(bits) + " tweak",
-            [&]() {
-                vector<uint8_t> key_vec(bits/8);
-                vector<uint8_t> tweak(16);
-                generate_random_key(key_vec.data(), key_vec.size());
-                generate_random_key(tweak.data(), tweak.size());
-                return new AESNI(bits, rounds, key_vec, tweak);
-            },
-            [](uint8_t* buf, size_t sz, AESNI* aes) {
-                tAES_NI_decrypt_no_keygen(buf, sz, aes);
-                delete aes;
-            }
-        );
-        results.push_back({string("T-AES NI Decrypt ") + to_string(bits) + " tweak", dec_tweak});
+    const vector<Case> cases = make_cases(opt);
+    if (opt.scaling) {
+        const auto scaling = run_scaling(opt, cases);
+        cout << "=============================================================\n";
+        write_scaling_csv(opt.csv, scaling);
+        cout << "\nResults saved to: " << opt.csv << "\n";
+        return 0;
+    }
+
+    // One run of one case: warmup, then samples appended to ticks. Counters
+    // cover the timed samples only, which includes the few instructions of
+    // the TSC reads around each call
+    auto run = [&](const function<void()>& op, Result& r, vector<uint64_t>& ticks) {
+        bench::warmup(op, opt.cfg);
+        if (counters)
+            counters->start();
+        vector<uint64_t> run_ticks = bench::sample(op, opt.cfg);
+        if (counters) {
+            const perf::Reading reading = counters->stop();
+            if (r.run_p50.empty())
+                r.counters = reading;
+            else
+                r.counters.add(reading);
+        }
+        r.run_p50.push_back(bench::Stats::of(run_ticks).p50);
+        ticks.insert(ticks.end(), run_ticks.begin(), run_ticks.end());
     };
 
-    // Add all suites
-    add_taes_sw_suite(128, 10);
-    add_taes_ni_suite(128, 10);
-    add_taes_sw_suite(192, 12);
-    add_taes_ni_suite(192, 12);
-    add_taes_sw_suite(256, 14);
-    add_taes_ni_suite(256, 14);
-
-    // ================================
-    // OpenSSL XTS-128 and XTS-256 only
-    // ================================
-    cout << "\n[OpenSSL] XTS-128 Encryption\n";
-    auto result_xts128_enc = benchmark_operation(
-        "OpenSSL XTS-128 Encryption",
-        []() {
-            uint8_t key1[16], key2[16];
-            generate_random_key(key1, 16);
-            generate_random_key(key2, 16);
-            uint8_t full_key[32];
-            memcpy(full_key, key1, 16);
-            memcpy(full_key + 16, key2, 16);
-
-            EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
-            uint8_t iv[16] = {0}; // XTS requires an IV (tweak)
-            EVP_EncryptInit_ex(ctx, EVP_aes_128_xts(), nullptr, full_key, iv);
-            return ctx;
-        },
-        [](uint8_t* buf, size_t sz, EVP_CIPHER_CTX* ctx) {
-            openssl_xts_encrypt_no_keygen(buf, sz, ctx);
-            EVP_CIPHER_CTX_free(ctx);
+    vector<Result> results;
+    print_header();
+    for (size_t size : opt.sizes) {
+        // Inputs are generated once per size; every call rewrites the buffer
+        bench::Buffer buffer(size);
+        bench::fill_random(buffer.data(), size, size);
+        bench::Buffer dst(size);
+        memset(dst.data(), 0, size);
+
+        // Runs are interleaved (every case, then every case again) so that
+        // drift in clock speed or load is spread over all cases alike
+        vector<Result> rows(cases.size() + 1);
+        for (size_t i = 0; i < rows.size(); i++) {
+            rows[i].name = i ? cases[i - 1].name : "memcpy";
+            rows[i].size = size;
         }
-    );
-    results.push_back({"OpenSSL XTS-128 Encrypt", result_xts128_enc});
-
-    cout << "\n[OpenSSL] XTS-128 Decryption\n";
-    auto result_xts128_dec = benchmark_operation(
-        "OpenSSL XTS-128 Decryption",
-        []() {
-            uint8_t key1[16], key2[16];
-            generate_random_key(key1, 16);
-            generate_random_key(key2, 16);
-            uint8_t full_key[32];
-            memcpy(full_key, key1, 16);
-            memcpy(full_key + 16, key2, 16);
-
-            EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
-            uint8_t iv[16] = {0};
-            EVP_DecryptInit_ex(ctx, EVP_aes_128_xts(), nullptr, full_key, iv);
-            return ctx;
-        },
-        [](uint8_t* buf, size_t sz, EVP_CIPHER_CTX* ctx) {
-            openssl_xts_decrypt_no_keygen(buf, sz, ctx);
-            EVP_CIPHER_CTX_free(ctx);
+        vector<vector<uint64_t>> ticks(rows.size());
+        for (unsigned k = 0; k < opt.runs; k++) {
+            run([&] { memcpy(dst.data(), buffer.data(), size); }, rows[0], ticks[0]);
+            for (size_t i = 0; i < cases.size(); i++)
+                run([&] { cases[i].run(buffer.data(), size); }, rows[i + 1], ticks[i + 1]);
         }
-    );
-    results.push_back({"OpenSSL XTS-128 Decrypt", result_xts128_dec});
-
-    cout << "\n[OpenSSL] XTS-256 Encryption\n";
-    auto result_xts256_enc = benchmark_operation(
-        "OpenSSL XTS-256 Encryption",
-        []() {
-            uint8_t key1[32], key2[32];
-            generate_random_key(key1, 32);
-            generate_random_key(key2, 32);
-            uint8_t full_key[64];
-            memcpy(full_key, key1, 32);
-            memcpy(full_key + 32, key2, 32);
-
-            EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
-            uint8_t iv[16] = {0}; // XTS requires an IV (tweak)
-            EVP_EncryptInit_ex(ctx, EVP_aes_256_xts(), nullptr, full_key, iv);
-            return ctx;
-        },
-        [](uint8_t* buf, size_t sz, EVP_CIPHER_CTX* ctx) {
-            openssl_xts_encrypt_no_keygen(buf, sz, ctx);
-            EVP_CIPHER_CTX_free(ctx);
+
+        for (size_t i = 0; i < rows.size(); i++) {
+            rows[i].stats = bench::Stats::of(ticks[i]);
+            rows[i].set_interval();
         }
-    );
-    results.push_back({"OpenSSL XTS-256 Encrypt", result_xts256_enc});
-
-    cout << "\n[OpenSSL] XTS-256 Decryption\n";
-    auto result_xts256_dec = benchmark_operation(
-        "OpenSSL XTS-256 Decryption",
-        []() {
-            uint8_t key1[32], key2[32];
-            generate_random_key(key1, 32);
-            generate_random_key(key2, 32);
-            uint8_t full_key[64];
-            memcpy(full_key, key1, 32);
-            memcpy(full_key + 32, key2, 32);
-
-            EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
-            uint8_t iv[16] = {0};
-            EVP_DecryptInit_ex(ctx, EVP_aes_256_xts(), nullptr, full_key, iv);
-            return ctx;
-        },
-        [](uint8_t* buf, size_t sz, EVP_CIPHER_CTX* ctx) {
-            openssl_xts_decrypt_no_keygen(buf, sz, ctx);
-            EVP_CIPHER_CTX_free(ctx);
+        for (Result& r : rows) {
+            r.memcpy_gbps = size / rows[0].stats.p50;
+            results.push_back(r);
+            print_row(r);
         }
-    );
-    results.push_back({"OpenSSL XTS-256 Decrypt", result_xts256_dec});
-
-    // ========== Print Results Table ==========
-    cout << "\n=============================================================\n";
-    cout << "  BENCHMARK RESULTS (Peak Speed = Minimum Time)\n";
-    cout << "=============================================================\n";
-    const int NAME_W = 34;     // width for operation name
-    const int NUM_W  = 14;     // width for numeric columns
-    cout << left << setw(NAME_W) << "Operation"
-        << right << setw(NUM_W) << "Min (μs)"
-        << setw(NUM_W) << "Avg (μs)"
-        << setw(NUM_W) << "Max (μs)"
-        << setw(NUM_W) << "Throughput (GB/s)"
-        << endl;
-    cout << string(NAME_W + 4*NUM_W, '-') << endl;
-
-    for (const auto& [name, res] : results) {
-       cout << left << setw(NAME_W) << name
-           << right << setw(NUM_W) << fixed << setprecision(2) << (res.min_ns / 1000.0)
-           << setw(NUM_W) << fixed << setprecision(2) << res.latency_us()
-           << setw(NUM_W) << fixed << setprecision(2) << (res.max_ns / 1000.0)
-           << setw(NUM_W) << fixed << setprecision(3) << res.throughput_gbps()
-           << endl;
     }
     cout << "=============================================================\n";
 
-    // ========== Write CSV ==========
-    ofstream csv("benchmark_results_comparison.csv");
-    csv << "Operation,Min_ns,Avg_ns,Max_ns,Throughput_GBps,Latency_us\n";
-    for (const auto& [name, res] : results) {
-        csv << name << ","
-            << res.min_ns << ","
-            << res.avg_ns() << ","
-            << res.max_ns << ","
-            << res.throughput_gbps() << ","
-            << res.latency_us() << "\n";
+    if (counters) {
+        cout << "\nHARDWARE COUNTERS (user space, per byte; misses and faults per KiB)\n";
+        print_counters_header();
+        for (const Result& r : results)
+            print_counters_row(r);
+        cout << "=============================================================\n";
     }
-    csv.close();
-    cout << "\nResults saved to: benchmark_results_comparison.csv\n";
 
-    // ========== Speed Comparison ==========
-    cout << "\n=============================================================\n";
-    cout << "  RELATIVE PERFORMANCE (Based on Peak Speed = Min Time)\n";
-    cout << "=============================================================\n";
-    auto get_speed = [&](const string& name) -> double {
-        for (const auto& p : results) if (p.first == name) return 1.0 / p.second.min_ns;
-        return 0.0;
-    };
-    string baseline_name = "T-AES SW Encrypt 128 no-tweak";
-    double base = get_speed(baseline_name);
-    if (base == 0.0) {
-        cout << "Baseline '" << baseline_name << "' not found.\n";
-    } else {
-        cout << "Baseline: " << baseline_name << "\n";
-        struct Row { string name; string label; } rows[] = {
-            {"T-AES NI Encrypt 128 no-tweak", "T-AES AES-NI 128 (no-tweak)"},
-            {"T-AES SW Encrypt 128 tweak",    "T-AES SW 128 (tweak)"},
-            {"OpenSSL XTS-128 Encrypt",       "OpenSSL XTS-128"},
-            {"OpenSSL XTS-256 Encrypt",       "OpenSSL XTS-256"}
-        };
-        for (const auto& r : rows) {
-            double sp = get_speed(r.name);
-            if (sp > 0) {
-                cout << "  " << setw(NAME_W-2) << left << r.label << right << fixed << setprecision(2)
-                     << (sp / base) << "x\n";
-            }
+    write_csv(opt.csv, results);
+    cout << "\nResults saved to: " << opt.csv << "\n";
+    const Environment env = Environment::probe();
+    if (!opt.json.empty()) {
+        try {
+            write_json(opt.json, env, opt, results);
+        } catch (const exception& e) {
+            cerr << e.what() << "\n";
+            return 1;
         }
+        cout << "JSON report saved to: " << opt.json << "\n";
     }
-    cout << "=============================================================\n";
-
+    // Exit status 2 on a regression, so a job can gate on it
+    if (!opt.compare.empty() &&
+        compare_results(baseline, opt.compare, env, results, opt.threshold) > 0)
+        return 2;
     return 0;
 }
@@ -61,7 +61,7 @@ int main() {
         vector<uint8_t> plaintext = random_block();
         vector<uint8_t> key      = random_block();
         
-        // Start with tweak=0
+        // Start with tweak=0 (key expansion happens once per key)
         vector<uint8_t> tweak = int_to_tweak(0);
         AES aes(128, 10, key, tweak);
         vector<uint8_t> last_cipher = aes.encrypt_block(plaintext);
@@ -70,9 +70,8 @@ int main() {
         for (uint64_t t = 1; t < MAX_TWEAK; ++t) {
             // Create new tweak
             tweak = int_to_tweak(t);
-            // Create new AES with new tweak (key expansion happens here, but measurement is only for encryption)
-            AES aes_new(128, 10, key, tweak);
-            vector<uint8_t> cipher = aes_new.encrypt_block(plaintext);
+            // Per-call tweak: only the tweak-round key is recomputed
+            vector<uint8_t> cipher = aes.encrypt_block(plaintext, tweak);
             
             // Measure Hamming distance from previous cipher
             int dist = hamming_distance(cipher, last_cipher);
@@ -1,6 +1,11 @@
 #include "../include/AES.hpp"
+#include "../include/AESBitslice.hpp"
+#include "../include/AESNI.hpp"
+#include "../include/AESVperm.hpp"
+#include <algorithm>
 #include <iostream>
 #include <iomanip>
+#include <random>
 #include <vector>
 #include <string>
 #include <sstream>
@@ -28,6 +33,93 @@ string bytesToHex(const vector<uint8_t>& bytes) {
     return ss.str();
 }
 
+// Sector API (Sectors.hpp): a scatter list of spans, out of order and in
+// separate buffers, must give the same bytes as one encrypt_blocks over the
+// whole device image with the same base tweak, and decrypt back. Bad unit
+// sizes, ragged spans and sector numbers whose block counter overflows
+// must be rejected. Returns the number of failed checks.
+template <typename Engine>
+int checkSectors(const Engine& aes, const string& name) {
+    int failed = 0;
+    mt19937_64 rng(42);
+    for (size_t unit : {size_t(512), size_t(4096)}) {
+        for (bool tweaked : {false, true}) {
+            const size_t units = 24, size = units * unit;
+            vector<uint8_t> plain(size), expected(size), tweak(16, 0);
+            for (auto& b : plain) b = static_cast<uint8_t>(rng());
+            if (tweaked)
+                for (auto& b : tweak) b = static_cast<uint8_t>(rng());
+            // No tweak means a zero base: unit tweaks are the block counters
+            aes.encrypt_blocks(plain.data(), expected.data(), size / 16, tweak.data());
+
+            // Runs of 1..4 units, each copied into its own buffer, shuffled
+            vector<pair<size_t, size_t>> runs; // first unit, unit count
+            for (size_t u = 0; u < units;) {
+                const size_t n = min<size_t>(1 + rng() % 4, units - u);
+                runs.push_back({u, n});
+                u += n;
+            }
+            shuffle(runs.begin(), runs.end(), rng);
+            vector<vector<uint8_t>> buffers;
+            vector<sectors::Span> spans;
+            for (const auto& r : runs)
+                buffers.emplace_back(plain.begin() + r.first * unit,
+                                     plain.begin() + (r.first + r.second) * unit);
+            for (size_t i = 0; i < runs.size(); i++)
+                spans.push_back({runs[i].first, buffers[i].data(), buffers[i].size()});
+
+            const uint8_t* t = tweaked ? tweak.data() : nullptr;
+            aes.encrypt_sectors(spans.data(), spans.size(), unit, t);
+            bool same = true;
+            for (size_t i = 0; i < runs.size(); i++)
+                same &= equal(buffers[i].begin(), buffers[i].end(),
+                              expected.begin() + runs[i].first * unit);
+            aes.decrypt_sectors(spans.data(), spans.size(), unit, t);
+            bool back = true;
+            for (size_t i = 0; i < runs.size(); i++)
+                back &= equal(buffers[i].begin(), buffers[i].end(),
+                              plain.begin() + runs[i].first * unit);
+
+            const string what = name + " " + to_string(unit) + " B units" +
+                                (tweaked ? ", tweak" : ", no tweak");
+            cout << "  " << (same ? "✓" : "✗") << " " << what << ": scattered == whole buffer\n";
+            cout << "  " << (back ? "✓" : "✗") << " " << what << ": decrypt round trip\n";
+            failed += !same + !back;
+        }
+    }
+
+    // Each call must throw the given exception type
+    auto rejects = [&](const string& what, auto call, auto expected) {
+        bool ok = false;
+        try {
+            call();
+        } catch (const decltype(expected)&) {
+            ok = true;
+        } catch (...) {
+        }
+        cout << "  " << (ok ? "✓" : "✗") << " " << name << ": rejects " << what << "\n";
+        failed += !ok;
+    };
+    vector<uint8_t> buf(8192);
+    rejects("a 1000 B unit", [&] {
+        sectors::Span s{0, buf.data(), 1000};
+        aes.encrypt_sectors(&s, 1, 1000, nullptr);
+    }, invalid_argument(""));
+    rejects("a 8192 B unit", [&] {
+        sectors::Span s{0, buf.data(), 8192};
+        aes.encrypt_sectors(&s, 1, 8192, nullptr);
+    }, invalid_argument(""));
+    rejects("a span that is not whole units", [&] {
+        sectors::Span s{0, buf.data(), 512 + 16};
+        aes.encrypt_sectors(&s, 1, 512, nullptr);
+    }, invalid_argument(""));
+    rejects("a sector number past the block counter", [&] {
+        sectors::Span s{UINT64_MAX / 32, buf.data(), 1024};
+        aes.decrypt_sectors(&s, 1, 512, nullptr);
+    }, out_of_range(""));
+    return failed;
+}
+
 struct TestVector {
     string name;
     int keySize;
@@ -88,7 +180,7 @@ int main() {
 
         // Create AES instance with empty tweak
         vector<uint8_t> emptyTweak;
-        AES aes(test.keySize, test.rounds, key, emptyTweak);
+        const AES aes(test.keySize, test.rounds, key, emptyTweak);
 
         // Encrypt
         vector<uint8_t> ciphertext = aes.encrypt_block(plaintext);
@@ -123,6 +215,64 @@ int main() {
         cout << "\n";
     }
 
+    // A round count that does not match the key size must not construct
+    cout << "Round count argument\n";
+    cout << "==========================================\n";
+    try {
+        AES aes(128, 12, vector<uint8_t>(16), vector<uint8_t>());
+        cout << "  ✗ AES-128 with 12 rounds was accepted\n";
+        failed++;
+    } catch (const invalid_argument&) {
+        cout << "  ✓ AES-128 with 12 rounds rejected\n";
+    }
+    cout << "\n";
+
+    // The lookup-free expansions must give the table-driven schedule
+    cout << "Constant-time key schedules\n";
+    cout << "==========================================\n";
+    for (int bits : {128, 192, 256}) {
+        vector<uint8_t> key(bits / 8), tweak(16);
+        for (size_t i = 0; i < key.size(); i++) key[i] = static_cast<uint8_t>(i * 29 + 3);
+        for (size_t i = 0; i < tweak.size(); i++) tweak[i] = static_cast<uint8_t>(0xf0 - i);
+        const auto ref = AES::make_schedule(bits, key, tweak);
+        auto same = [&](const KeySchedule& ks) {
+            return memcmp(ks.enc, ref->enc, sizeof ref->enc) == 0 &&
+                   memcmp(ks.dec, ref->dec, sizeof ref->dec) == 0 &&
+                   memcmp(ks.tweaked_enc, ref->tweaked_enc, 16) == 0 &&
+                   memcmp(ks.tweaked_dec, ref->tweaked_dec, 16) == 0;
+        };
+        auto check = [&](const string& name, const KeySchedule& ks) {
+            if (same(ks)) {
+                cout << "  ✓ " << name << " matches\n";
+            } else {
+                cout << "  ✗ " << name << " differs\n";
+                failed++;
+            }
+        };
+        const string b = "-" + to_string(bits);
+        check("Bitslice" + b, *AESBitslice::make_schedule(bits, key, tweak));
+        if (cpu_features().ssse3)
+            check("Vperm" + b, *AESVperm::make_schedule(bits, key, tweak));
+    }
+    cout << "\n";
+
+    cout << "Sector API (scatter-gather data units)\n";
+    cout << "==========================================\n";
+    for (int bits : {128, 256}) {
+        const int rounds = bits == 128 ? 10 : 14;
+        vector<uint8_t> key(bits / 8);
+        for (size_t i = 0; i < key.size(); i++) key[i] = static_cast<uint8_t>(i * 7 + 1);
+        const vector<uint8_t> noTweak;
+        const string b = "-" + to_string(bits);
+        failed += checkSectors(AES(bits, rounds, key, noTweak), "AES" + b);
+        failed += checkSectors(AESBitslice(bits, rounds, key, noTweak), "Bitslice" + b);
+        if (cpu_features().ssse3)
+            failed += checkSectors(AESVperm(bits, rounds, key, noTweak), "Vperm" + b);
+        if (Check_CPU_support_AES())
+            failed += checkSectors(AESNI(bits, rounds, key, noTweak), "AES-NI" + b);
+    }
+    cout << "\n";
+
     cout << "==========================================\n";
     cout << "Results: " << passed << " encryption passed, " << failed << " failed (encryption or decryption)\n";
 
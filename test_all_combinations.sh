@@ -177,6 +177,57 @@ test_sw_hw_match() {
     fi
 }
 
+# Encrypts input with one engine: engine size password tweak input output.
+# Engines: table, bitslice, bitslice-sse2 (TAES_BITSLICE=sse2), vperm and
+# aesni (the hardware tools); mode is encrypt or decrypt
+run_engine() {
+    local engine="$1"
+    local mode="$2"
+    local size="$3"
+    local password="$4"
+    local tweak="$5"
+    local input_file="$6"
+    local output_file="$7"
+
+    case "$engine" in
+        aesni)
+            ./bin/${mode}_aesni $size "$password" $tweak < "$input_file" > "$output_file" ;;
+        bitslice-sse2)
+            TAES_BITSLICE=sse2 ./bin/$mode $size "$password" $tweak --engine bitslice \
+                < "$input_file" > "$output_file" ;;
+        *)
+            ./bin/$mode $size "$password" $tweak --engine $engine \
+                < "$input_file" > "$output_file" ;;
+    esac
+}
+
+# Test every engine produces the table engine's ciphertext and decrypts it
+test_engine_match() {
+    local engine="$1"
+    local size="$2"
+    local password="$3"
+    local tweak="$4"
+    local input_file="$5"
+
+    local test_name="AES-$size $engine vs table $(wc -c < "$input_file") bytes"
+    if [ -n "$tweak" ]; then
+        test_name="$test_name with tweak"
+    else
+        test_name="$test_name without tweak"
+    fi
+
+    rm -f /tmp/cipher_ref.bin /tmp/cipher_engine.bin /tmp/output.txt
+    if run_engine table encrypt $size "$password" "$tweak" "$input_file" /tmp/cipher_ref.bin 2>/dev/null &&
+       run_engine "$engine" encrypt $size "$password" "$tweak" "$input_file" /tmp/cipher_engine.bin 2>/dev/null &&
+       cmp -s /tmp/cipher_ref.bin /tmp/cipher_engine.bin &&
+       run_engine "$engine" decrypt $size "$password" "$tweak" /tmp/cipher_engine.bin /tmp/output.txt 2>/dev/null &&
+       cmp -s "$input_file" /tmp/output.txt; then
+        print_result "$test_name" "PASS"
+    else
+        print_result "$test_name" "FAIL"
+    fi
+}
+
 # Test with irregular file size (ciphertext stealing)
 test_irregular_size() {
     local impl="$1"
@@ -337,6 +388,40 @@ main() {
         echo ""
     fi
 
+    # ==========================
+    # Test 7: Engine Ciphertext Equality
+    # ==========================
+    print_header "Test 7: Engine Ciphertext Equality"
+
+    ENGINES=(table bitslice bitslice-sse2)
+    if grep -qw ssse3 /proc/cpuinfo; then
+        ENGINES+=(vperm)
+    else
+        echo -e "${YELLOW}No SSSE3: skipping the vperm engine${NC}"
+    fi
+    if grep -qw aes /proc/cpuinfo; then
+        ENGINES+=(aesni)
+    else
+        echo -e "${YELLOW}No AES-NI: skipping the hardware engine${NC}"
+    fi
+    # Empty, one block, one block + 1, the longest single stealing step and
+    # a multi-step tail that is not a multiple of the 16-block bitslice step
+    for bytes in 0 16 17 31 4113; do
+        head -c $bytes /dev/urandom > /tmp/engine_input_$bytes.bin
+    done
+
+    for size in "${KEY_SIZES[@]}"; do
+        for tweak in "" "$TWEAK"; do
+            for bytes in 0 16 17 31 4113; do
+                for engine in "${ENGINES[@]}"; do
+                    test_engine_match "$engine" "$size" "$PASSWORD" "$tweak" \
+                        /tmp/engine_input_$bytes.bin
+                done
+            done
+        done
+    done
+    echo ""
+
     # ==========================
     # Summary
     # ==========================
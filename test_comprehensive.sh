@@ -106,6 +106,144 @@ run_test() {
     return 0
 }
 
+# Function to run a check command (a shell function or program) and count
+# its exit status as the result; unlike run_test a failure does not stop
+# the script, so every case is reported
+check() {
+    local test_name="$1"
+    shift
+
+    TOTAL_TESTS=$((TOTAL_TESTS + 1))
+    echo -n "Testing $test_name... "
+    if "$@" 2>/dev/null; then
+        echo -e "${GREEN}PASSED${NC}"
+        PASSED_TESTS=$((PASSED_TESTS + 1))
+    else
+        echo -e "${RED}FAILED${NC}"
+        FAILED_TESTS=$((FAILED_TESTS + 1))
+    fi
+}
+
+# Function to create a file of random bytes
+create_random_file() {
+    head -c "$1" /dev/urandom > "$2"
+}
+
+# Container round trip: encrypt_bin decrypt_bin "chunk option" "tweak"
+# mode input. Modes: stream (stdin/stdout), pipe (decrypt reads a pipe,
+# so the frames are followed without the index), file (--in/--out) and
+# file-j (--in/--out decrypted on 4 threads through the index)
+container_roundtrip() {
+    local enc="$1" dec="$2" chunk="$3" tweak="$4" mode="$5" input="$6"
+    rm -f container.bin container.out
+    case "$mode" in
+        stream)
+            $enc 256 $PASSWORD $tweak --container $chunk < "$input" > container.bin &&
+            $dec 256 $PASSWORD $tweak --container < container.bin > container.out ;;
+        pipe)
+            $enc 256 $PASSWORD $tweak --container $chunk < "$input" |
+            $dec 256 $PASSWORD $tweak --container > container.out ;;
+        file)
+            $enc 256 $PASSWORD $tweak --container $chunk --in "$input" --out container.bin &&
+            $dec 256 $PASSWORD $tweak --container --in container.bin --out container.out ;;
+        file-j)
+            $enc 256 $PASSWORD $tweak --container $chunk --in "$input" --out container.bin &&
+            $dec 256 $PASSWORD $tweak --container -j 4 --in container.bin --out container.out ;;
+    esac || return 1
+    cmp -s "$input" container.out
+}
+
+# The command must fail (exit status other than 0)
+fails() {
+    ! "$@" > /dev/null
+}
+
+# Writes bytes (printf escapes) over a file at an offset
+patch_file() {
+    printf "$3" | dd of="$1" bs=1 seek="$2" conv=notrunc 2>/dev/null
+}
+
+# Pipe consumer that splices its input on into a chain of 1 MiB pipes and
+# only reads them at EOF, so it holds references to every page it was given
+# long after they left the first pipe (like pv or tee into another pipe)
+splice_on() {
+    python3 -c '
+import fcntl, os, sys
+pipes = []
+while True:
+    r, w = os.pipe()
+    try:
+        fcntl.fcntl(w, 1031, 1 << 20)  # F_SETPIPE_SZ
+    except OSError:
+        pass
+    room = fcntl.fcntl(w, 1032)  # F_GETPIPE_SZ
+    while room > 0:
+        n = os.splice(0, w, room)
+        if n == 0:
+            break
+        room -= n
+    os.close(w)
+    pipes.append(r)
+    if room > 0:
+        break
+for r in pipes:
+    while data := os.read(r, 1 << 16):
+        sys.stdout.buffer.write(data)
+'
+}
+
+# Runs a tool in one I/O mode: binary "tweak" mode input output. The modes
+# are the cases below; stream is plain stdin/stdout, the in-place ones
+# work on a copy of the input
+io_mode_crypt() {
+    local bin="$1" tweak="$2" mode="$3" input="$4" output="$5"
+    local key="256 $PASSWORD $tweak"
+    rm -f "$output"
+    case "$mode" in
+        stream)          $bin $key < "$input" > "$output" ;;
+        stream-j)        $bin $key -j 4 < "$input" > "$output" ;;
+        overlap)         $bin $key --overlap < "$input" > "$output" ;;
+        vmsplice)        $bin $key --vmsplice < "$input" | cat > "$output" ;;
+        vmsplice-splice) $bin $key --vmsplice < "$input" | splice_on > "$output" ;;
+        file)            $bin $key --in "$input" --out "$output" ;;
+        file-j)          $bin $key -j 4 --in "$input" --out "$output" ;;
+        uring)           $bin $key --io uring --in "$input" --out "$output" ;;
+        direct)          $bin $key --direct --in "$input" --out "$output" ;;
+        direct-j)        $bin $key --direct -j 4 --in "$input" --out "$output" ;;
+        in-place)        cp "$input" "$output" && $bin $key --in-place "$output" ;;
+        in-place-uring)  cp "$input" "$output" && $bin $key --io uring --in-place "$output" ;;
+        in-place-direct) cp "$input" "$output" && $bin $key --direct --in-place "$output" ;;
+        *)               return 1 ;;
+    esac
+}
+
+# An I/O mode must produce the stdin/stdout ciphertext and decrypt it back:
+# encrypt_bin decrypt_bin "tweak" mode input reference_ciphertext
+io_mode_matches() {
+    local enc="$1" dec="$2" tweak="$3" mode="$4" input="$5" reference="$6"
+    io_mode_crypt $enc "$tweak" $mode "$input" io_mode.enc &&
+    cmp -s "$reference" io_mode.enc &&
+    io_mode_crypt $dec "$tweak" $mode io_mode.enc io_mode.out &&
+    cmp -s "$input" io_mode.out
+}
+
+# Range decryption: decrypt_bin "tweak" ciphertext plaintext offset length.
+# The ciphertext is redirected from the file, so stdin is seekable.
+# decrypt --offset/--length must equal the same bytes cut by dd out of the
+# full decryption (the plaintext); an empty length means "to the end"
+range_matches() {
+    local dec="$1" tweak="$2" cipher="$3" plain="$4" offset="$5" length="$6"
+    local count="" range="--offset $offset"
+    if [ -n "$length" ]; then
+        count="count=$length"
+        range="$range --length $length"
+    fi
+    dd if="$plain" of=range.expected bs=64K iflag=skip_bytes,count_bytes \
+       skip="$offset" $count 2>/dev/null &&
+    $dec 256 $PASSWORD $tweak $range < "$cipher" > range.out &&
+    cmp -s range.expected range.out
+}
+
 # Build all programs
 echo -e "${YELLOW}Building programs...${NC}"
 cd ..
@@ -286,16 +424,146 @@ python3 -c "print('X' * 10240, end='')" > $large_file  # 10KB file
 echo "Measuring performance on 10KB file..."
 for aes_size in "${AES_SIZES[@]}"; do
     echo -n "AES-${aes_size}: "
-    time_output=$(time (../bin/encrypt $aes_size $PASSWORD < $large_file > /dev/null) 2>&1)
+    time_output=$( { time ../bin/encrypt $aes_size $PASSWORD < $large_file > /dev/null; } 2>&1 )
     echo "$time_output" | grep real | awk '{print $2}'
     
     echo -n "AES-NI-${aes_size}: "
-    time_output=$(time (../bin/encrypt_aesni $aes_size $PASSWORD < $large_file > /dev/null) 2>&1)
+    time_output=$( { time ../bin/encrypt_aesni $aes_size $PASSWORD < $large_file > /dev/null; } 2>&1 )
     echo "$time_output" | grep real | awk '{print $2}'
 done
 
 echo ""
 
+# Test 7: Chunked container format (--container)
+echo -e "${BLUE}=== Test 7: Container Format ===${NC}"
+for n in 17 4113 300007; do
+    create_random_file $n "container_${n}.bin"
+done
+create_random_file 3145735 container_large.bin  # three 1 MiB chunks + 7
+for chunk in "--chunk-size 16" "--chunk-size 4096" ""; do
+    chunk_name="${chunk#--chunk-size }"
+    chunk_name="chunk ${chunk_name:-default}"
+    for tweak in "" "$TWEAK_PASSWORD"; do
+        tweak_name=$([ -n "$tweak" ] && echo "+T" || echo "")
+        for mode in stream pipe file file-j; do
+            for n in 17 4113 300007; do
+                check "Container${tweak_name} $mode $chunk_name ${n}B" \
+                      container_roundtrip ../bin/encrypt_aesni ../bin/decrypt_aesni \
+                      "$chunk" "$tweak" $mode "container_${n}.bin"
+            done
+        done
+    done
+done
+for mode in stream pipe file file-j; do
+    check "Container+T $mode chunk default 3 MiB" \
+          container_roundtrip ../bin/encrypt_aesni ../bin/decrypt_aesni \
+          "" "$TWEAK_PASSWORD" $mode container_large.bin
+done
+check "Container+T AES→AES-NI file chunk 4096" \
+      container_roundtrip ../bin/encrypt ../bin/decrypt_aesni \
+      "--chunk-size 4096" "$TWEAK_PASSWORD" file container_300007.bin
+check "Container+T AES-NI→AES file-j chunk 4096" \
+      container_roundtrip ../bin/encrypt_aesni ../bin/decrypt \
+      "--chunk-size 4096" "$TWEAK_PASSWORD" file-j container_300007.bin
+
+# Negative cases, on a 128-bit container of 300007 bytes in 4 KiB chunks
+../bin/encrypt_aesni 128 $PASSWORD --container --chunk-size 4096 \
+    --in container_300007.bin --out container_neg.bin
+neg_size=$(wc -c < container_neg.bin)
+check "Container key size mismatch (file)" \
+      fails ../bin/decrypt_aesni 256 $PASSWORD --container --in container_neg.bin --out neg.out
+check "Container key size mismatch (stream)" \
+      fails ../bin/decrypt_aesni 256 $PASSWORD --container < container_neg.bin
+head -c $((neg_size - 5)) container_neg.bin > container_trunc.bin
+check "Container truncated index" \
+      fails ../bin/decrypt_aesni 128 $PASSWORD --container --in container_trunc.bin --out neg.out
+cp container_neg.bin container_bad_footer.bin
+patch_file container_bad_footer.bin $((neg_size - 24)) '\xff\xff\xff\xff'
+check "Container corrupt index offset" \
+      fails ../bin/decrypt_aesni 128 $PASSWORD --container --in container_bad_footer.bin --out neg.out
+cp container_neg.bin container_bad_entry.bin
+patch_file container_bad_entry.bin $((neg_size - 24 - 8 * 10)) '\x01\x02\x03'
+check "Container corrupt index entry" \
+      fails ../bin/decrypt_aesni 128 $PASSWORD --container --in container_bad_entry.bin --out neg.out
+head -c 7 container_17.bin > short.bin
+rm -f neg.out
+../bin/encrypt_aesni 128 $PASSWORD --container --in short.bin --out neg.out 2>/dev/null || true
+check "Container short input leaves no output" test ! -e neg.out
+echo ""
+
+# Test 8: Range decryption (--offset/--length)
+echo -e "${BLUE}=== Test 8: Range Decryption ===${NC}"
+create_random_file 10007 range_plain.bin
+create_random_file 2097165 range_large.bin  # two 1 MiB chunks + 13
+for tweak in "" "$TWEAK_PASSWORD"; do
+    tweak_name=$([ -n "$tweak" ] && echo "+T" || echo "")
+    ../bin/encrypt_aesni 256 $PASSWORD $tweak < range_plain.bin > range_cipher.bin
+    ../bin/decrypt_aesni 256 $PASSWORD $tweak < range_cipher.bin > range_full.bin
+    cmp -s range_plain.bin range_full.bin
+    size=10007
+    # Block boundaries, then every offset into the last 31 bytes where the
+    # ciphertext stealing tail lives (the last full block starts at size-23)
+    for offset in 0 1 15 16 17 4096 $(seq $((size - 32)) $((size - 1))) $size; do
+        for length in 1 15 16 31 ""; do
+            for tool in decrypt decrypt_aesni; do
+                check "Range${tweak_name} $tool offset $offset length ${length:-end}" \
+                      range_matches ../bin/$tool "$tweak" range_cipher.bin \
+                      range_full.bin $offset "$length"
+            done
+        done
+    done
+    ../bin/encrypt_aesni 256 $PASSWORD $tweak < range_large.bin > range_cipher.bin
+    ../bin/decrypt_aesni 256 $PASSWORD $tweak < range_cipher.bin > range_full.bin
+    size=2097165
+    for offset in 1048560 1048576 $((size - 40)) $((size - 20)); do
+        for length in 64 1048593 ""; do
+            check "Range${tweak_name} decrypt_aesni 2 MiB offset $offset length ${length:-end}" \
+                  range_matches ../bin/decrypt_aesni "$tweak" range_cipher.bin \
+                  range_full.bin $offset "$length"
+        done
+    done
+done
+../bin/encrypt_aesni 256 $PASSWORD < range_plain.bin > range_cipher.bin
+check "Range with --in/--out" \
+      eval "../bin/decrypt_aesni 256 $PASSWORD --offset 10000 --in range_cipher.bin --out range.out &&
+            cmp -s range.out <(tail -c 7 range_plain.bin)"
+check "Range rejects pipe input" \
+      fails eval "cat range_cipher.bin | ../bin/decrypt_aesni 256 $PASSWORD --offset 16 --length 16"
+check "Range rejects offset past the end" \
+      fails ../bin/decrypt_aesni 256 $PASSWORD --offset 10008 < range_cipher.bin
+check "Range rejects offset past the end (software)" \
+      fails ../bin/decrypt 256 $PASSWORD --offset 10008 --length 1 < range_cipher.bin
+check "Range rejects encryption" \
+      fails ../bin/encrypt_aesni 256 $PASSWORD --offset 0 < range_plain.bin
+echo ""
+
+# Test 9: I/O modes give the same ciphertext as stdin/stdout
+echo -e "${BLUE}=== Test 9: I/O Mode Equivalence ===${NC}"
+IO_MODES=(stream-j overlap vmsplice vmsplice-splice file file-j uring
+          direct direct-j in-place in-place-uring in-place-direct)
+# Around a 4 KiB page, a few pages plus one byte, and several 1 MiB
+# chunks with a ragged tail
+IO_SIZES=(17 4095 4096 4097 12289 5242883)
+for n in "${IO_SIZES[@]}"; do
+    create_random_file $n "io_${n}.bin"
+done
+for tools in "encrypt_aesni decrypt_aesni" "encrypt decrypt"; do
+    set -- $tools
+    enc=../bin/$1
+    dec=../bin/$2
+    for tweak in "" "$TWEAK_PASSWORD"; do
+        tweak_name=$([ -n "$tweak" ] && echo "+T" || echo "")
+        for n in "${IO_SIZES[@]}"; do
+            io_mode_crypt $enc "$tweak" stream "io_${n}.bin" io_reference.enc
+            for mode in "${IO_MODES[@]}"; do
+                check "I/O mode${tweak_name} $1 $mode ${n}B" \
+                      io_mode_matches $enc $dec "$tweak" $mode "io_${n}.bin" io_reference.enc
+            done
+        done
+    done
+done
+echo ""
+
 # Final results
 echo -e "${BLUE}=== Test Results Summary ===${NC}"
 echo "Total tests run: $TOTAL_TESTS"